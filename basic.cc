@@ -48,6 +48,18 @@ void errAbort(const char *format, ...)
     exit(1);
 }
 
+bool input_error(const char *format, ...)
+/* Keep the message in load_error for the caller, returns false */
+{
+    char msg[4*LABEL_LEN];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+    load_error = msg;
+    return false;
+}
+
 long clock1000()
 /* A millisecond clock. */
 {
@@ -58,6 +70,14 @@ long clock1000()
     return (tv.tv_sec-origSec)*1000 + tv.tv_usec / 1000;
 }
 
+long clock_us()
+/* A microsecond clock, for timing that adds up across threads */
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec*1000000L + tv.tv_usec;
+}
+
 void uglyTime(const char *label, ...)
 /* Print label and how long it's been since last call.  Call with
  * a NULL label to initialize. */
@@ -75,6 +95,31 @@ void uglyTime(const char *label, ...)
     va_end(args);
 }
 
+Arena::~Arena()
+{
+    vector<char *>::iterator i;
+    tr(chunks, i) free(*i);
+}
+
+void *Arena::alloc(size_t n)
+/* n bytes aligned for any of the POG types */
+{
+    n = (n + 7) & ~(size_t) 7;
+    allocs++, bytes += n;
+    while (cur < chunks.size() && used + n > sizes[cur]) cur++, used = 0;
+    if (cur == chunks.size())
+    {
+        size_t size = MAX(n, (size_t) 1<<16);
+        char *p = (char *) malloc(size);
+        if (p == NULL) errAbort("Out of memory for %lu bytes", (unsigned long) size);
+        chunks.push_back(p);
+        sizes.push_back(size);
+        used = 0;
+    }
+    used += n;
+    return chunks[cur] + used - n;
+}
+
 FILE *mustOpen(const char *fileName, const char *mode)
 /* Open a file or die */
 {
@@ -97,3 +142,135 @@ FILE *mustOpen(const char *fileName, const char *mode)
     return f;
 }
 
+void name_file(char *fn, const char *format, ...)
+/* Print a file name into fn, LABEL_LEN bytes, or die if it does not fit */
+{
+    va_list args;
+    int n;
+    va_start(args, format);
+    n = vsnprintf(fn, LABEL_LEN, format, args);
+    va_end(args);
+    if (n < 0 || n >= LABEL_LEN)
+        errAbort("File name %s... is longer than %d characters",
+                 fn, LABEL_LEN-1);
+}
+
+
+struct Run_state
+{
+    int njobs, next;
+    void (*job)(int, int, void *);
+    void *arg;
+    pthread_mutex_t lock;
+};
+
+struct Run_worker
+{
+    Run_state *state;
+    int id;
+    pthread_t tid;
+};
+
+static void *run_worker(void *p)
+/* Keep taking the next job until all are handed out */
+{
+    Run_worker *w = (Run_worker *) p;
+    Run_state *st = w->state;
+    int i;
+    for (;;)
+    {
+        pthread_mutex_lock(&st->lock);
+        i = st->next++;
+        pthread_mutex_unlock(&st->lock);
+        if (i >= st->njobs) break;
+        st->job(i, w->id, st->arg);
+    }
+    return NULL;
+}
+
+void parallel_run(int njobs, int nthreads,
+                  void (*job)(int i, int thread, void *arg), void *arg)
+/* Run job(i, thread, arg) for i in [0, njobs) on nthreads worker threads,
+ * jobs are handed out in index order */
+{
+    int i, err;
+    if (nthreads > njobs) nthreads = njobs;
+    if (nthreads <= 1)
+    {
+        for (i=0; i<njobs; i++) job(i, 0, arg);
+        return;
+    }
+
+    Run_state st;
+    st.njobs = njobs, st.next = 0;
+    st.job = job, st.arg = arg;
+    pthread_mutex_init(&st.lock, NULL);
+
+    vector<Run_worker> workers(nthreads);
+    for (i=0; i<nthreads; i++)
+    {
+        workers[i].state = &st;
+        workers[i].id = i;
+        if ((err = pthread_create(&workers[i].tid, NULL,
+                                  run_worker, &workers[i])) != 0)
+            errAbort("Can't create thread: %s", strerror(err));
+    }
+    for (i=0; i<nthreads; i++) pthread_join(workers[i].tid, NULL);
+
+    pthread_mutex_destroy(&st.lock);
+}
+
+static inline unsigned long anchor_key(const Score_t &s, bool by_y)
+{
+    return by_y ? (unsigned long) s.y << 32 | (unsigned) s.x :
+           (unsigned long) s.x << 32 | (unsigned) s.y;
+}
+
+static bool anchor_cmp_y(const Score_t &a, const Score_t &b)
+{
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+void radix_sort(vector<Score_t> &a, bool by_y)
+/* Stable LSD radix sort by (x, y), or by (y, x) with by_y, on the packed 64
+ * bit key, 11 bits per pass; the passes where all keys share the digit are
+ * skipped, so gene ranks take four. Coordinates must not be negative */
+{
+    const int BITS = 11, RADIX = 1<<BITS, PASSES = (64+BITS-1)/BITS;
+    int n = a.size(), i, d, sum, c;
+    unsigned long key;
+
+    if (n < 256)
+    {
+        if (by_y) stable_sort(a.begin(), a.end(), anchor_cmp_y);
+        else stable_sort(a.begin(), a.end());
+        return;
+    }
+
+    vector<int> count(PASSES*RADIX, 0);
+    for (i=0; i<n; i++)
+    {
+        key = anchor_key(a[i], by_y);
+        for (d=0; d<PASSES; d++)
+            count[d*RADIX + ((key >> d*BITS) & (RADIX-1))]++;
+    }
+
+    vector<Score_t> tmp(n);
+    Score_t *src = &a[0], *dst = &tmp[0];
+    for (d=0; d<PASSES; d++)
+    {
+        int *bucket = &count[d*RADIX];
+        key = anchor_key(src[0], by_y);
+        if (bucket[(key >> d*BITS) & (RADIX-1)] == n) continue;
+
+        for (i=sum=0; i<RADIX; i++)
+            c = bucket[i], bucket[i] = sum, sum += c;
+        for (i=0; i<n; i++)
+        {
+            key = anchor_key(src[i], by_y);
+            dst[bucket[(key >> d*BITS) & (RADIX-1)]++] = src[i];
+        }
+        swap(src, dst);
+    }
+    if (src != &a[0]) copy(src, src+n, &a[0]);
+}
@@ -6,6 +6,7 @@
 #endif
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cstdarg>
 #include <cerrno>
@@ -13,6 +14,8 @@
 #include <cmath>
 #include <ctime>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <pthread.h>
 #include <argp.h>
 #include <string>
 #include <vector>
@@ -21,6 +24,7 @@
 #include <set>
 #include <map>
 #include <algorithm>
+#include <new>
 
 #ifndef M_LN2
 #define M_LN2 0.69314718055994530942
@@ -48,18 +52,58 @@ using namespace std;
 #endif
 
 /***** Data structures *****/
-struct Blast_record
+/* The accepted BLAST hits, one column per field: match i is between
+ * genes gene1[i] and gene2[i] (index into gene_list) with e-value
+ * score[i]. index_pairs() puts the matches of each mol_pair together, in
+ * the order they were read, then the pair of a match follows from
+ * pair_offsets and the mol_pair column is dropped */
+struct Match_store
 {
-    string gene1, gene2;
-    string mol_pair;
-    int pair_id;
-    int node;
-    double score;
+    vector<int> gene1, gene2;
+    vector<double> score;
+    vector<int> mol_pair;  // index into pair_list, until index_pairs()
+
+    int size() const { return gene1.size(); }
+    void clear()
+    {
+        gene1.clear(), gene2.clear(), score.clear(), mol_pair.clear();
+    }
+    void swap(Match_store &m)
+    {
+        gene1.swap(m.gene1), gene2.swap(m.gene2);
+        score.swap(m.score), mol_pair.swap(m.mol_pair);
+    }
+};
+/* With OUT_OF_CORE, match_list only buffers the matches being read, every
+ * OUT_OF_CORE MB of them go to an unlinked temporary file as one chunk
+ * per mol_pair. The chunks of pair p are chunks[pair_chunks[p] ..
+ * pair_chunks[p+1]-1], in the order they were read */
+struct Spill_chunk
+{
+    long offset;
+    int pair;
+    int count;  // matches, stored as the gene1, gene2 and score columns
+};
+struct Spill_index
+{
+    int fd;  // -1 while nothing is spilled
+    long size;
+    vector<Spill_chunk> chunks;
+    vector<int> pair_chunks;
+
+    Spill_index() : fd(-1), size(0) {}
+    ~Spill_index();
+    void clear();  // also closes the file
+    void swap(Spill_index &s)
+    {
+        std::swap(fd, s.fd), std::swap(size, s.size);
+        chunks.swap(s.chunks), pair_chunks.swap(s.pair_chunks);
+    }
 };
 struct Gene_feat
 {
     string name;
-    string mol;
+    int mol;  // index into mol_list
     int mid;
     int node;
     bool operator < (const Gene_feat &g) const
@@ -97,7 +141,7 @@ unsigned from :
 };
 struct Score_t
 {
-    int pairID;  // identifier of match pair
+    int pairID;  // index into match_list
     int x, y;  // x,y coordinates
     float score;
     bool operator< (const Score_t & node) const
@@ -111,8 +155,52 @@ struct Path_t
     int rc;  // sum of row and column of last entry
     int sub;
 };
+struct Chain_count
+{
+    long full;  // anchors chained if every pass started from scratch
+    long done;  // anchors actually chained
+    long steps;  // predecessors scanned (classic) or range maxima (sparse)
+    int passes;  // chaining passes over both directions
+    int tests;  // chains tested for significance
+    long test_us;  // and the time it took
+
+    Chain_count() : full(0), done(0), steps(0), passes(0), tests(0),
+        test_us(0) {}
+    void add(const Chain_count &c)
+    {
+        full += c.full, done += c.done, steps += c.steps;
+        passes += c.passes, tests += c.tests, test_us += c.test_us;
+    }
+};
+// what mcscan_chain did with one mol_pair
+struct Pair_stats
+{
+    int mol_pair;  // index into pair_list
+    int matches;
+    int anchors;  // left by the repeat filter
+    int segments;  // significant chains
+    Chain_count dp;
+    long filter_us, chain_us;
+};
 
 // pog (partial order graph)
+// what POG_main did with one pivot
+struct Pivot_stats
+{
+    int mol;  // index into mol_list
+    int clusters;  // tandem clusters of the pivot
+    int regions;  // syntenic regions aligned onto it
+    int fused;  // regions fused, each takes a column of the block
+    long matches;  // matching node pairs in the dynamic programming
+    long sweeps;  // spread_POG passes over master or slave
+    int nodes;  // POG nodes allocated
+    long arena_bytes;  // taken by them, the pivots share the process RSS
+    int rows, cols;  // size of the block written
+    long us;
+
+    Pivot_stats() : mol(-1), clusters(0), regions(0), fused(0), matches(0),
+        sweeps(0), nodes(0), arena_bytes(0), rows(0), cols(0), us(0) {}
+};
 struct Syn_region
 {
     Seg_feat *s;
@@ -121,15 +209,77 @@ struct Syn_region
     bool match1;
 };
 
+/* Bump allocator for the partial order graph of a pivot: memory comes from
+ * large chunks, reset() rewinds them all at once and keeps them for reuse */
+struct Arena
+{
+    vector<char *> chunks;
+    vector<size_t> sizes;
+    size_t cur, used;  // chunk being filled and the bytes taken from it
+    long allocs;       // requests served since the last reset
+    size_t bytes;      // and the bytes handed out for them
+
+    Arena() : cur(0), used(0), allocs(0), bytes(0) {}
+    ~Arena();
+    void *alloc(size_t n);
+    /* n bytes aligned for any of the POG types */
+    void reset() { cur = 0, used = 0, allocs = 0, bytes = 0; }
+};
+
+/* A few elements kept inline, more spill to memory from an Arena, which
+ * owns it, so there is nothing to destroy */
+template <class T, int N>
+struct Small_vec
+{
+    int n, cap;
+    T *heap;
+    T local[N];
+
+    Small_vec() : n(0), cap(N), heap(NULL) {}
+    T *begin() { return heap ? heap : local; }
+    T *end() { return begin() + n; }
+    const T *begin() const { return heap ? heap : local; }
+    const T *end() const { return begin() + n; }
+    int size() const { return n; }
+    bool empty() const { return n == 0; }
+    void clear() { n = 0; }
+    void push_back(const T &x, Arena &a)
+    {
+        if (n == cap)
+        {
+            T *p = (T *) a.alloc(2*cap*sizeof(T));
+            copy(begin(), end(), p);
+            heap = p, cap *= 2;
+        }
+        begin()[n++] = x;
+    }
+    void insert(const T &x, Arena &a)
+    /* push_back unless x is already there */
+    {
+        if (find(begin(), end(), x) == end()) push_back(x, a);
+    }
+};
+
+// genes [first, last) of a tandem cluster, in chromosome order
+struct Gene_range
+{
+    Gene_feat *const *first, *const *last;
+    bool empty() const { return first == last; }
+};
+
 struct POG_node
 {
-    geneSet master_genes, genes;
-    set<POG_node *> fusion, next;
+    Gene_range master_genes, genes;
+    // slave nodes fused into this one in the order of fusion, and the
+    // nodes following it
+    Small_vec<POG_node *, 2> fusion, next;
     int node;
-    bool visited;
+    int rank;  // position in master or slave during align_POG, else -1
+    list<POG_node *>::iterator at;  // position in the POG_order holding it
     Syn_region *r;
 };
 typedef list<POG_node *> POG_order;
+typedef vector<POG_node *> POG_path;
 
 struct DP
 {
@@ -153,12 +303,26 @@ struct End_point
 };
 
 /***** All data *****/
-// use gene name to search its node, mol, mid
-extern map<string, Gene_feat> gene_map;
-extern vector<Blast_record> match_list;
+// genes sorted by chromosome and position, names are only needed
+// for output, everything else refers to genes by their index
+extern vector<Gene_feat> gene_list;
+// chromosome names in name order
+extern vector<string> mol_list;
+extern Match_store match_list;
 extern vector<Seg_feat> seg_list;
+// mol_pair name to its index in pair_list, indices follow name order
 extern map<string, int> mol_pairs;
-extern map<string, geneSet > chr_map;
+extern vector<string> pair_list;
+// matches of pair p are pair_offsets[p]..pair_offsets[p+1]-1 in match_list,
+// with OUT_OF_CORE the offsets only count the matches in spill_index
+extern vector<int> pair_offsets;
+// genes in the mcl file grouped by chromosome, indexed like mol_list
+extern vector<geneSet> chr_map;
+// where the matches are with OUT_OF_CORE, match_list then only holds the
+// anchors of seg_list once the pairs are chained
+extern Spill_index spill_index;
+// why the input was rejected, see input_error()
+extern string load_error;
 
 /***** CONSTANTS *****/
 // match bonus
@@ -183,6 +347,15 @@ extern int CUTOFF_SCORE;
 extern bool IN_SYNTENY;
 // use base pair distance rather than gene ranks
 extern bool USE_BP;
+// number of worker threads for pairwise chaining
+extern int NUM_THREADS;
+// chain with the sweep over range maximum trees instead of the classic loop
+extern bool SPARSE_CHAIN;
+// the sweep keeps one tree of 2n keys per gap penalty (EXTENSION_DIST/
+// UNIT_DIST+1 of them), with more it falls back to the classic loop
+#define SPARSE_MAX_BANDS 32
+// MB of matches read before they are spilled to disk, 0 keeps them in memory
+extern int OUT_OF_CORE;
 
 // direction in the 2d dynamic matrix
 enum { DIAG, UP, LEFT, DEL };
@@ -204,15 +377,35 @@ void errAbort(const char *format, ...)
 /* Print error message to stderr and exit */
 __attribute__((noreturn, format(printf, 1, 2)));
 
+bool input_error(const char *format, ...)
+/* Keep the message in load_error for the caller, returns false */
+__attribute__((format(printf, 1, 2)));
+
 long clock1000();
 /* A millisecond clock. */
 
+long clock_us();
+/* A microsecond clock, for timing that adds up across threads */
+
 void uglyTime(const char *label, ...)
 /* Print label and how long it's been since last call.  Call with
  * a NULL label to initialize. */
 __attribute__((format(printf, 1, 2)));
 
+
 FILE *mustOpen(const char *fileName, const char *mode);
 /* Open a file or die */
 
+void name_file(char *fn, const char *format, ...)
+/* Print a file name into fn, LABEL_LEN bytes, or die if it does not fit */
+__attribute__((format(printf, 2, 3)));
+
+void parallel_run(int njobs, int nthreads,
+                  void (*job)(int i, int thread, void *arg), void *arg);
+/* Run job(i, thread, arg) for i in [0, njobs) on nthreads worker threads,
+ * jobs are handed out in index order */
+
+void radix_sort(vector<Score_t> &a, bool by_y=false);
+/* Stable sort of anchors by (x, y), or by (y, x) with by_y */
+
 #endif
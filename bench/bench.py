@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+# -*- coding: UTF-8 -*-
+
+"""
+Scaling benchmark of mcscan on synthetic genomes (make bench)
+
+For every scale a genome set is made by synth_genome, then mcscan runs
+  - -a with the classic and the sparse chaining engine, which must agree;
+    this .aligns, made with the noise hits, is checked against the planted
+    blocks and the gene families,
+  - the full pipeline.
+The phase times come from --stats. dag_main is the sum over pairs of
+chain_seconds (print_chains in both directions, significance tests
+included), is_significant the sum of test_seconds. The exponents at the
+end are log(t2/t1)/log(n2/n1) between successive scales, 1 being linear.
+"""
+
+import json
+import math
+import os
+import os.path as op
+import subprocess
+import sys
+import time
+
+BENCH_DIR = op.dirname(op.abspath(__file__))
+MCSCAN = op.join(BENCH_DIR, "..", "mcscan")
+SYNTH = op.join(BENCH_DIR, "synth_genome")
+MICRO = op.join(BENCH_DIR, "micro")
+
+COLUMNS = ["genes", "matches", "blast_MB", "read_blast", "parse_MB/s",
+           "chain", "dag_main", "is_significant", "print_align", "pog",
+           "classic_a", "sparse_a", "total", "planted", "recovered",
+           "precision"]
+TIMES = ["read_blast", "chain", "dag_main", "is_significant",
+         "print_align", "pog", "classic_a", "sparse_a", "total"]
+
+
+# where report() writes, stdout and the --out file
+OUTPUT = [sys.stdout]
+
+
+def report(line=""):
+    for f in OUTPUT:
+        f.write(line + "\n")
+        f.flush()
+
+
+def run(args, log):
+    """run a program, its messages go to log"""
+    start = time.time()
+    if subprocess.call(args, stdout=log, stderr=subprocess.STDOUT) != 0:
+        sys.exit("failed: %s" % " ".join(args))
+    return time.time() - start
+
+
+def phases(fn):
+    stats = json.load(open(fn))
+    t = {}
+    for p in stats["phases"]:
+        t[p["name"]] = t.get(p["name"], 0) + p["seconds"]
+    return stats, t
+
+
+def read_bed(prefix):
+    """gene name to (chromosome, rank)"""
+    genes, rank = {}, {}
+    for row in open(prefix + ".bed"):
+        chr, start, stop, name = row.split()[:4]
+        genes[name] = (chr, rank.get(chr, 0))
+        rank[chr] = rank.get(chr, 0) + 1
+    return genes
+
+
+def read_families(prefix):
+    family = {}
+    for i, row in enumerate(open(prefix + ".mcl")):
+        for name in row.split():
+            family[name] = i
+    return family
+
+
+def read_aligns(fn, genes):
+    """spans of every alignment by chromosome pair, and its anchors"""
+    spans, anchors, cur = {}, [], None
+    for row in open(fn):
+        if row.startswith("## Alignment"):
+            cur = None
+            continue
+        if row[0] in "#\n":
+            continue
+        a, b = row.split("\t")[1:3]
+        anchors.append((a, b))
+        (ca, ia), (cb, ib) = genes[a], genes[b]
+        if cur is None:
+            cur = [ia, ia, ib, ib]
+            spans.setdefault((ca, cb), []).append(cur)
+        cur[0], cur[1] = min(cur[0], ia), max(cur[1], ia)
+        cur[2], cur[3] = min(cur[2], ib), max(cur[3], ib)
+    return spans, anchors
+
+
+def covers(lo, hi, a, b):
+    """whether lo..hi holds at least half of a..b"""
+    return min(hi, b) - max(lo, a) + 1 >= (b - a + 1) / 2.0
+
+
+def recovery(prefix, aligns_fn):
+    """planted blocks, those found by an alignment covering half of them
+    on both sides, and the share of anchors within a gene family"""
+    genes = read_bed(prefix)
+    family = read_families(prefix)
+    spans, anchors = read_aligns(aligns_fn, genes)
+
+    planted = found = 0
+    for row in open(prefix + ".truth"):
+        a1, a2, b1, b2 = row.split()[:4]
+        (ca, x1), (ca, x2) = genes[a1], genes[a2]
+        (cb, y1), (cb, y2) = genes[b1], genes[b2]
+        planted += 1
+        for s in spans.get((ca, cb), []):
+            if covers(s[0], s[1], x1, x2) and covers(s[2], s[3], y1, y2):
+                found += 1
+                break
+        else:
+            for s in spans.get((cb, ca), []):
+                if covers(s[2], s[3], x1, x2) and covers(s[0], s[1], y1, y2):
+                    found += 1
+                    break
+
+    same = len([1 for a, b in anchors if family[a] == family[b]])
+    return planted, found, same / float(max(len(anchors), 1))
+
+
+def bench_scale(n, options, log):
+    prefix = op.join(options.work, "syn%d" % n)
+    mc = [MCSCAN, "-t", str(options.threads)]
+    r = {"genes": n}
+
+    run([SYNTH, "-n", str(n)] + options.synth.split() + [prefix], log)
+    r["blast_MB"] = op.getsize(prefix + ".blast") / 1e6
+
+    r["classic_a"] = run(mc + ["-a", "--stats", prefix + ".classic.json",
+                               prefix], log)
+    os.rename(prefix + ".aligns", prefix + ".a.aligns")
+    classic = open(prefix + ".a.aligns").read()
+    r["sparse_a"] = run(mc + ["-a", "--chain=sparse", "--stats",
+                              prefix + ".sparse.json", prefix], log)
+    if open(prefix + ".aligns").read() != classic:
+        sys.exit("%s: the chaining engines disagree" % prefix)
+    r["classic_a"] = phases(prefix + ".classic.json")[1]["chain"]
+    r["sparse_a"] = phases(prefix + ".sparse.json")[1]["chain"]
+
+    r["total"] = run(mc + ["--stats", prefix + ".json", prefix], log)
+    stats, t = phases(prefix + ".json")
+    r["genes"] = stats["genes"]
+    r["matches"] = stats["matches"]
+    for k in ("read_blast", "chain", "print_align", "pog"):
+        r[k] = t.get(k, 0)
+    r["parse_MB/s"] = r["blast_MB"] / max(r["read_blast"], 1e-6)
+    r["dag_main"] = sum(p["chain_seconds"] for p in stats["pairs"])
+    r["is_significant"] = sum(p["test_seconds"] for p in stats["pairs"])
+    # the pairwise run sees the noise hits that the .mcl filters out
+    r["planted"], found, r["precision"] = recovery(prefix,
+                                                   prefix + ".a.aligns")
+    r["recovered"] = found / float(max(r["planted"], 1))
+    return r
+
+
+def fmt(k, v):
+    if k in ("genes", "matches", "planted"):
+        return "%d" % v
+    if k in ("recovered", "precision"):
+        return "%.3f" % v
+    return "%.3f" % v if v < 100 else "%.1f" % v
+
+
+def main():
+    from optparse import OptionParser
+
+    parser = OptionParser("%prog [options]")
+    parser.add_option("--scales", default="10000 100000 1000000 5000000",
+                      help="genes of each synthetic genome set [%default]")
+    parser.add_option("--threads", default=1, type="int",
+                      help="mcscan -t [%default]")
+    parser.add_option("--work", default=op.join(BENCH_DIR, "data"),
+                      help="where the genomes go [%default]")
+    parser.add_option("--synth", default="",
+                      help="more synth_genome options, e.g. \"-p 3 -x 5\"")
+    parser.add_option("--out", default="",
+                      help="a copy of the report goes there")
+    parser.add_option("--min_recovered", default=0.9, type="float",
+                      help="fail below this share of planted blocks "
+                      "[%default]")
+    options, args = parser.parse_args()
+
+    scales = [int(x) for x in options.scales.replace(",", " ").split()]
+    if not op.isdir(options.work):
+        os.makedirs(options.work)
+    log = open(op.join(options.work, "bench.log"), "w")
+    if options.out:
+        OUTPUT.append(open(options.out, "w"))
+
+    report("# mcscan scaling, %d thread(s), times in seconds" %
+           options.threads)
+    report("\t".join(COLUMNS))
+    rows = []
+    for n in scales:
+        r = bench_scale(n, options, log)
+        rows.append(r)
+        report("\t".join(fmt(k, r[k]) for k in COLUMNS))
+
+    if len(rows) > 1:
+        report()
+        report("# scaling exponent between successive scales")
+        report("\t".join(["genes"] + TIMES))
+        for a, b in zip(rows, rows[1:]):
+            e = [math.log(max(b[k], 1e-4) / max(a[k], 1e-4)) /
+                 math.log(float(b["genes"]) / a["genes"]) for k in TIMES]
+            report("\t".join(["%d-%d" % (a["genes"], b["genes"])] +
+                              ["%.2f" % x for x in e]))
+
+    report()
+    micro = subprocess.Popen([MICRO], stdout=subprocess.PIPE)
+    for line in micro.stdout:
+        report(line.decode().rstrip("\n"))
+    if micro.wait() != 0:
+        sys.exit("failed: %s" % MICRO)
+
+    bad = [r for r in rows if r["recovered"] < options.min_recovered]
+    for r in bad:
+        report("%d genes: only %.1f%% of the planted blocks recovered" %
+               (r["genes"], 100 * r["recovered"]))
+    sys.exit(1 if bad else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,185 @@
+/*
+ * Microbenchmarks of the inner routines of pairwise chaining (make bench)
+ *
+ * radix_sort against std::sort and std::stable_sort on random anchors,
+ * the e-value terms of is_significant with and without the tables of
+ * init_permutation, and parse_double against strtod on BLAST e-values.
+ * All of them also check that the fast version returns what the plain
+ * one does. The sort times include copying the input.
+ */
+
+#include "basic.h"
+#include "permutation.h"
+#include "line_reader.h"
+
+static unsigned long rng_state = 88172645463325252UL;
+
+static int below(int n)
+/* xorshift64, in [0, n) */
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (int) (rng_state % n);
+}
+
+static double ns_per(long start, long items)
+/* nanoseconds per item since clock_us() start */
+{
+    return (clock_us() - start) * 1000.0 / MAX(items, 1L);
+}
+
+static bool same_order(const vector<Score_t> &a, const vector<Score_t> &b)
+{
+    int i, n = a.size();
+    for (i=0; i<n; i++)
+        if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].pairID != b[i].pairID)
+            return false;
+    return true;
+}
+
+static void bench_sort()
+/* anchors of a pair with n matches between two chromosomes of n genes,
+ * repeated so that every size sorts about 1e7 anchors */
+{
+    int n, r, reps, i;
+    long start;
+    double t_radix, t_sort, t_stable;
+    vector<Score_t> orig, a, b;
+
+    printf("#anchors\tradix_sort ns\tstd::sort ns\tstable_sort ns\t"
+           "speedup\tsame order\n");
+    for (n=10000; n<=10000000; n*=10)
+    {
+        orig.resize(n);
+        for (i=0; i<n; i++)
+        {
+            orig[i].pairID = i;
+            orig[i].x = below(n), orig[i].y = below(n);
+            orig[i].score = 40;
+        }
+        reps = MAX(10000000 / n, 1);
+
+        start = clock_us();
+        for (r=0; r<reps; r++) a = orig, radix_sort(a);
+        t_radix = ns_per(start, (long) reps*n);
+
+        start = clock_us();
+        for (r=0; r<reps; r++) b = orig, sort(all(b));
+        t_sort = ns_per(start, (long) reps*n);
+
+        start = clock_us();
+        for (r=0; r<reps; r++) b = orig, stable_sort(all(b));
+        t_stable = ns_per(start, (long) reps*n);
+
+        printf("%d\t%.1f\t%.1f\t%.1f\t%.2fx\t%s\n", n, t_radix, t_sort,
+               t_stable, t_sort / t_radix, same_order(a, b) ? "yes" : "NO");
+    }
+}
+
+static void bench_ln()
+/* ln_perm(N, m) + ln_spacing() of random chains, the way is_significant
+ * adds them up, first from the fallback code, then from the tables */
+{
+    const int chains = 200000, max_n = 20000, max_gap = 200;
+    vector<Score_t> score;
+    vector<int> N, first;
+    vector<int> ans;
+    vector<double> plain(chains), tab(chains);
+    int c, i, m, x, y;
+    long start, terms = 0;
+    Score_t s;
+
+    for (c=0; c<chains; c++)
+    {
+        first.push_back(score.size());
+        m = 5 + below(40);
+        N.push_back(m + below(max_n - m));
+        x = below(1000000), y = below(1000000);
+        for (i=0; i<m; i++, terms++)
+        {
+            s.x = x += 1 + below(max_gap), s.y = y += 1 + below(max_gap);
+            score.push_back(s);
+        }
+    }
+    first.push_back(score.size());
+
+    double t[2];
+    int pass;
+    for (pass=0; pass<2; pass++)
+    {
+        vector<double> &out = pass ? tab : plain;
+        if (pass) init_permutation(max_n, max_gap + 1);
+        else init_permutation(-1, -1);
+        start = clock_us();
+        for (c=0; c<chains; c++)
+        {
+            ans.clear();
+            for (i=first[c]; i<first[c+1]; i++) ans.push_back(i);
+            out[c] = ln_perm(N[c], ans.size()) + ln_spacing(score, ans);
+        }
+        t[pass] = ns_per(start, terms);
+    }
+
+    bool same = true;
+    for (c=0; c<chains; c++) same = same && plain[c] == tab[c];
+    printf("#e-value terms\tplain ns/anchor\ttables ns/anchor\tspeedup\t"
+           "bit-identical\n");
+    printf("%ld\t%.1f\t%.1f\t%.2fx\t%s\n", terms, t[0], t[1], t[0] / t[1],
+           same ? "yes" : "NO");
+}
+
+static void bench_parse()
+/* e-values as BLAST prints them (2e-28, 0.003, 1e-163, 3.2), and any
+ * double printed with 17 digits */
+{
+    const int n = 2000000;
+    vector<string> text(n);
+    vector<double> plain(n), fast(n);
+    char s[LABEL_LEN];
+    int i, bad = 0;
+    unsigned long bits;
+    double x;
+    long start;
+
+    for (i=0; i<n; i++)
+    {
+        switch (i % 4)
+        {
+        case 0: sprintf(s, "%de-%d", 1 + below(9), below(181)); break;
+        case 1: sprintf(s, "%.2g", (1 + below(999)) * 1e-5); break;
+        case 2: sprintf(s, "%d.%d", below(1000), below(10)); break;
+        default:
+            bits = (unsigned long) below(1 << 30) << 34 ^
+                   (unsigned long) below(1 << 30) << 4;
+            memcpy(&x, &bits, sizeof(x));
+            sprintf(s, "%.17g", x);
+        }
+        text[i] = s;
+    }
+
+    start = clock_us();
+    for (i=0; i<n; i++) plain[i] = strtod(text[i].c_str(), NULL);
+    double t_plain = ns_per(start, n);
+    start = clock_us();
+    for (i=0; i<n; i++)
+        if (!parse_double(text[i].data(), text[i].size(), &fast[i])) bad++;
+    double t_fast = ns_per(start, n);
+
+    for (i=0; i<n; i++)
+        if (memcmp(&plain[i], &fast[i], sizeof(double)) != 0) bad++;
+    printf("#e-values\tstrtod ns\tparse_double ns\tspeedup\t"
+           "bit-identical\n");
+    printf("%d\t%.1f\t%.1f\t%.2fx\t%s\n", n, t_plain, t_fast,
+           t_plain / t_fast, bad ? "NO" : "yes");
+}
+
+int main(int argc, char *argv[])
+{
+    bench_sort();
+    printf("\n");
+    bench_ln();
+    printf("\n");
+    bench_parse();
+    return 0;
+}
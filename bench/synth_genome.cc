@@ -0,0 +1,341 @@
+/*
+ * Synthetic genomes with planted synteny for the benchmarks (make bench)
+ *
+ * An ancestral genome of gene families is copied into SPECIES genomes of
+ * PLOIDY subgenomes each, as after whole genome duplications. Every copy
+ * loses genes (fractionation), is cut into segments that are inverted
+ * and shuffled over its chromosomes (rearrangements), and grows tandem
+ * arrays. All genes of a family hit each other, and random hits between
+ * unrelated genes add noise. The output is prefix.bed, prefix.blast and
+ * prefix.mcl (the true families), plus prefix.truth, which lists the
+ * collinear blocks planted between every two copies:
+ *
+ *     first1 last1 first2 last2 genes
+ *
+ * first1..last1 and first2..last2 being the outermost genes of the block
+ * on either chromosome, genes the ancestral genes the two copies share in
+ * it, in the same order or reversed.
+ */
+
+#include "basic.h"
+
+const char *argp_program_version = "synth_genome 0.8";
+
+static char doc[] = "synth_genome -- synthetic genomes with planted "
+                    "collinear blocks for the mcscan benchmarks";
+static char args_doc[] = "prefix";
+
+static struct argp_option options[] =
+{
+    {"genes", 'n', "GENES", 0, "genes in all genomes together, about" },
+    {"species", 's', "SPECIES", 0, "number of genomes" },
+    {"ploidy", 'p', "PLOIDY", 0, "subgenomes per genome, >1 for whole "
+     "genome duplications" },
+    {"chromosomes", 'c', "CHRS", 0, "chromosomes per subgenome" },
+    {"retain", 'r', "FRACTION", 0, "ancestral genes kept by each copy" },
+    {"block", 'b', "GENES", 0, "mean ancestral genes between two "
+     "rearrangement breakpoints" },
+    {"tandem", 't', "FRACTION", 0, "genes followed by a tandem array of "
+     "1 to 3 more copies" },
+    {"noise", 'x', "HITS", 0, "random hits per gene between unrelated "
+     "genes" },
+    {"min_block", 'm', "GENES", 0, "smallest block listed in prefix.truth" },
+    {"seed", 'S', "SEED", 0, "random seed" },
+    { 0 }
+};
+
+static int GENES, SPECIES, PLOIDY, CHRS, BLOCK, MIN_BLOCK;
+static double RETAIN, TANDEM, NOISE;
+static unsigned long SEED;
+static char *PREFIX;
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'n': GENES = atoi(arg); break;
+    case 's': SPECIES = atoi(arg); break;
+    case 'p': PLOIDY = atoi(arg); break;
+    case 'c': CHRS = atoi(arg); break;
+    case 'r': RETAIN = atof(arg); break;
+    case 'b': BLOCK = atoi(arg); break;
+    case 't': TANDEM = atof(arg); break;
+    case 'x': NOISE = atof(arg); break;
+    case 'm': MIN_BLOCK = atoi(arg); break;
+    case 'S': SEED = strtoul(arg, NULL, 10); break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num >= 1) argp_usage(state);
+        PREFIX = arg;
+        break;
+    case ARGP_KEY_END:
+        if (state->arg_num < 1) argp_usage(state);
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+/* xorshift64*, so that a seed gives the same genomes everywhere */
+static unsigned long rng_state;
+
+static unsigned long rng()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717UL;
+}
+
+static double uniform()
+/* in [0, 1) */
+{
+    return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int below(int n)
+/* in [0, n) */
+{
+    return (int) (uniform() * n);
+}
+
+/* A gene of a copy, in chromosome order */
+struct Synth_gene
+{
+    int family;  // ancestral gene
+    int seg;  // rearrangement segment it came with, -1 for tandem copies
+};
+
+/* One subgenome, descended from the whole ancestor */
+struct Synth_copy
+{
+    string prefix;  // two letters, one per genome
+    int first_chr;  // number of its first chromosome in the genome
+    vector< vector<Synth_gene> > chrs;
+    // chromosome and position of the first gene of each family, -1 if lost
+    vector<int> chr_of, pos_of;
+};
+
+static string gene_name(const Synth_copy &c, int chr, int pos)
+{
+    char name[LABEL_LEN];
+    sprintf(name, "%s%dg%06d", c.prefix.c_str(), c.first_chr + chr, pos);
+    return name;
+}
+
+static void make_copy(Synth_copy &c, int families)
+/* fractionate, rearrange and grow tandems out of the ancestor */
+{
+    vector< vector<int> > segs;
+    vector<int> seg;
+    int f, i, k, chr, len, total = 0;
+
+    /* segments of kept genes, breakpoints after BLOCK genes on average */
+    for (f=0; f<families; f++)
+    {
+        if (uniform() < RETAIN) seg.push_back(f);
+        if (uniform() < 1.0/BLOCK && !seg.empty())
+        {
+            segs.push_back(seg);
+            seg.clear();
+        }
+    }
+    if (!seg.empty()) segs.push_back(seg);
+
+    /* inversions, then transpositions of whole segments */
+    for (i=0; i<(int) segs.size(); i++)
+    {
+        if (uniform() < 0.5) reverse(all(segs[i]));
+        total += segs[i].size();
+    }
+    for (i=segs.size()-1; i>0; i--) swap(segs[i], segs[below(i+1)]);
+
+    /* whole segments dealt out to the chromosomes in about equal shares */
+    c.chrs.assign(CHRS, vector<Synth_gene>());
+    c.chr_of.assign(families, -1);
+    c.pos_of.assign(families, -1);
+    Synth_gene g;
+    int placed = 0;
+    for (i=0; i<(int) segs.size(); i++)
+    {
+        chr = MIN((long) placed * CHRS / MAX(total, 1), CHRS-1);
+        placed += segs[i].size();
+        for (k=0; k<(int) segs[i].size(); k++)
+        {
+            g.family = segs[i][k];
+            g.seg = i;
+            c.chr_of[g.family] = chr;
+            c.pos_of[g.family] = c.chrs[chr].size();
+            c.chrs[chr].push_back(g);
+            if (uniform() < TANDEM)
+            {
+                g.seg = -1;
+                for (len=1+below(3); len>0; len--) c.chrs[chr].push_back(g);
+            }
+        }
+    }
+}
+
+static void write_bed(const vector<Synth_copy> &copies, const char *prefix)
+/* genes 1000 to 9000 bp apart, so -A has something to work with */
+{
+    char fn[LABEL_LEN];
+    int i, chr, pos, start;
+    sprintf(fn, "%s.bed", prefix);
+    FILE *fw = mustOpen(fn, "w");
+    for (i=0; i<(int) copies.size(); i++)
+    {
+        const Synth_copy &c = copies[i];
+        for (chr=0; chr<CHRS; chr++)
+        {
+            start = 0;
+            for (pos=0; pos<(int) c.chrs[chr].size(); pos++)
+            {
+                start += 1000 + below(8000);
+                fprintf(fw, "%s%d\t%d\t%d\t%s\n", c.prefix.c_str(),
+                        c.first_chr + chr, start, start + 800,
+                        gene_name(c, chr, pos).c_str());
+            }
+        }
+    }
+    fclose(fw);
+}
+
+static void write_families(const vector<Synth_copy> &copies, int families,
+                           const char *prefix)
+/* every pair of genes in a family hits, plus NOISE random hits per gene;
+ * the families themselves are the .mcl clusters */
+{
+    char fn[LABEL_LEN];
+    vector< vector<string> > members(families);
+    vector<string> genes;
+    int i, j, chr, pos, f;
+    long hits = 0;
+
+    for (i=0; i<(int) copies.size(); i++)
+    {
+        const Synth_copy &c = copies[i];
+        for (chr=0; chr<CHRS; chr++)
+            for (pos=0; pos<(int) c.chrs[chr].size(); pos++)
+            {
+                genes.push_back(gene_name(c, chr, pos));
+                members[c.chrs[chr][pos].family].push_back(genes.back());
+            }
+    }
+
+    sprintf(fn, "%s.blast", prefix);
+    FILE *fw = mustOpen(fn, "w");
+    for (f=0; f<families; f++)
+    {
+        const vector<string> &m = members[f];
+        for (i=0; i<(int) m.size(); i++)
+            for (j=i+1; j<(int) m.size(); j++, hits++)
+                fprintf(fw, "%s\t%s\t%.0e\n", m[i].c_str(), m[j].c_str(),
+                        pow(10., -20 - below(160)));
+    }
+    long noise = (long) (NOISE * genes.size());
+    for (; noise>0; noise--)
+    {
+        i = below(genes.size()), j = below(genes.size());
+        if (i == j) continue;
+        fprintf(fw, "%s\t%s\t%.0e\n", genes[i].c_str(), genes[j].c_str(),
+                pow(10., -5 - below(15)));
+        hits++;
+    }
+    fclose(fw);
+
+    sprintf(fn, "%s.mcl", prefix);
+    fw = mustOpen(fn, "w");
+    for (f=0; f<families; f++)
+    {
+        const vector<string> &m = members[f];
+        for (i=0; i<(int) m.size(); i++)
+            fprintf(fw, "%s%c", m[i].c_str(), i+1<(int) m.size() ? '\t' : '\n');
+    }
+    fclose(fw);
+    progress("%d genes, %ld BLAST hits written to %s.bed/.blast/.mcl",
+             (int) genes.size(), hits, prefix);
+}
+
+static int write_truth(const vector<Synth_copy> &copies, int families,
+                       const char *prefix)
+/* runs of ancestral genes that two copies keep in the same pair of
+ * segments are the planted blocks */
+{
+    char fn[LABEL_LEN];
+    int u, v, f, n = copies.size(), blocks = 0;
+    sprintf(fn, "%s.truth", prefix);
+    FILE *fw = mustOpen(fn, "w");
+
+    for (u=0; u<n; u++)
+        for (v=u+1; v<n; v++)
+        {
+            const Synth_copy &a = copies[u], &b = copies[v];
+            int key_a = -1, key_b = -1, first = -1, last = -1, size = 0;
+            for (f=0; f<=families; f++)
+            {
+                bool shared = f < families && a.chr_of[f] >= 0 &&
+                              b.chr_of[f] >= 0;
+                int sa = -2, sb = -2;
+                if (shared)
+                {
+                    sa = a.chrs[a.chr_of[f]][a.pos_of[f]].seg;
+                    sb = b.chrs[b.chr_of[f]][b.pos_of[f]].seg;
+                }
+                if (f < families && !shared) continue;
+                if (sa == key_a && sb == key_b)
+                {
+                    last = f, size++;
+                    continue;
+                }
+                /* the block of first..last ends here */
+                if (size >= MIN_BLOCK)
+                {
+                    int ca = a.chr_of[first], cb = b.chr_of[first];
+                    fprintf(fw, "%s\t%s\t%s\t%s\t%d\n",
+                            gene_name(a, ca, MIN(a.pos_of[first], a.pos_of[last])).c_str(),
+                            gene_name(a, ca, MAX(a.pos_of[first], a.pos_of[last])).c_str(),
+                            gene_name(b, cb, MIN(b.pos_of[first], b.pos_of[last])).c_str(),
+                            gene_name(b, cb, MAX(b.pos_of[first], b.pos_of[last])).c_str(),
+                            size);
+                    blocks++;
+                }
+                key_a = sa, key_b = sb, first = last = f, size = 1;
+            }
+        }
+    fclose(fw);
+    return blocks;
+}
+
+int main(int argc, char *argv[])
+{
+    GENES = 10000, SPECIES = 2, PLOIDY = 2, CHRS = 5;
+    RETAIN = 0.7, BLOCK = 60, TANDEM = 0.05, NOISE = 1;
+    MIN_BLOCK = 10, SEED = 1;
+    argp_parse(&argp, argc, argv, 0, 0, 0);
+    if (SPECIES < 1 || SPECIES > 26 || PLOIDY < 1 || CHRS < 1 ||
+            BLOCK < 1 || RETAIN <= 0)
+        errAbort("bad genome shape");
+    rng_state = SEED * 0x9E3779B97F4A7C15UL + 1;
+
+    /* ancestral families so that the copies add up to about GENES */
+    int ncopies = SPECIES * PLOIDY, i;
+    int families = MAX((int) (GENES / (ncopies * RETAIN * (1 + 2*TANDEM))),
+                       CHRS);
+    vector<Synth_copy> copies(ncopies);
+    for (i=0; i<ncopies; i++)
+    {
+        copies[i].prefix = string("S") + (char) ('a' + i / PLOIDY);
+        copies[i].first_chr = (i % PLOIDY) * CHRS + 1;
+        make_copy(copies[i], families);
+    }
+
+    write_bed(copies, PREFIX);
+    write_families(copies, families, PREFIX);
+    int blocks = write_truth(copies, families, PREFIX);
+    progress("%d planted blocks of %d or more genes in %s.truth",
+             blocks, MIN_BLOCK, PREFIX);
+    return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Binary snapshot of the parsed input (prefix.cache)
+ *
+ * Holds everything read_bed, read_mcl and read_blast build: the gene and
+ * chromosome tables, MCL node ids, the accepted matches with their scores
+ * and the per-pair index. The snapshot records size and modification time
+ * of the text files it was built from, and is only used while they match,
+ * so re-running with different -k, -g, -s skips the text parsing.
+ */
+
+#include "cache.h"
+
+#define CACHE_MAGIC "MCSCANC"
+#define CACHE_VERSION 3
+
+struct Cache_stamp
+{
+    long size, mtime, mtime_ns;
+};
+
+struct Cache_header
+{
+    char magic[8];
+    int version;
+    int record_size;  // bytes per match
+    int use_bp, with_mcl, from_m8;
+    // blast is the -m8 file with --ingest-m8
+    Cache_stamp bed, mcl, blast;
+};
+
+struct Cache_cursor
+{
+    const char *p, *end;
+    bool ok;
+};
+
+static bool get_stamp(const char *fn, Cache_stamp *s)
+/* size and mtime of fn, false if it does not exist */
+{
+    struct stat st;
+
+    memset(s, 0, sizeof(Cache_stamp));
+    if (stat(fn, &st) < 0) return false;
+    s->size = st.st_size;
+    s->mtime = st.st_mtim.tv_sec;
+    s->mtime_ns = st.st_mtim.tv_nsec;
+    return true;
+}
+
+static void make_header(const char *prefix_fn, bool with_mcl,
+                        const char *m8_fn, Cache_header *h)
+{
+    char fn[LABEL_LEN];
+
+    memset(h, 0, sizeof(Cache_header));
+    strcpy(h->magic, CACHE_MAGIC);
+    h->version = CACHE_VERSION;
+    h->record_size = 2*sizeof(int) + sizeof(double);
+    h->use_bp = USE_BP;
+    h->with_mcl = with_mcl;
+    h->from_m8 = m8_fn != NULL;
+    input_name(fn, prefix_fn, "bed");
+    get_stamp(fn, &h->bed);
+    if (with_mcl)
+    {
+        input_name(fn, prefix_fn, "mcl");
+        get_stamp(fn, &h->mcl);
+    }
+    if (m8_fn) get_stamp(m8_fn, &h->blast);
+    else
+    {
+        input_name(fn, prefix_fn, "blast");
+        get_stamp(fn, &h->blast);
+    }
+}
+
+static void get(Cache_cursor &c, void *dst, size_t n)
+{
+    if (!c.ok || (size_t)(c.end - c.p) < n)
+    {
+        c.ok = false;
+        return;
+    }
+    memcpy(dst, c.p, n);
+    c.p += n;
+}
+
+static int get_int(Cache_cursor &c)
+{
+    int x = 0;
+    get(c, &x, sizeof(int));
+    return c.ok && x >= 0 ? x : (c.ok = false, 0);
+}
+
+static void get_string(Cache_cursor &c, string &s)
+{
+    int len = get_int(c);
+    if (!c.ok || c.end - c.p < len)
+    {
+        c.ok = false;
+        return;
+    }
+    s.assign(c.p, len);
+    c.p += len;
+}
+
+template <class T> static void get_vector(Cache_cursor &c, vector<T> &v)
+{
+    int n = get_int(c);
+    if (!c.ok || (size_t)(c.end - c.p) / sizeof(T) < (size_t) n)
+    {
+        c.ok = false;
+        return;
+    }
+    v.resize(n);
+    if (n > 0) get(c, &v[0], n*sizeof(T));
+}
+
+static void put_int(FILE *fw, int x)
+{
+    fwrite(&x, sizeof(int), 1, fw);
+}
+
+static void put_string(FILE *fw, const string &s)
+{
+    put_int(fw, s.size());
+    fwrite(s.data(), 1, s.size(), fw);
+}
+
+template <class T> static void put_vector(FILE *fw, const vector<T> &v)
+{
+    put_int(fw, v.size());
+    if (!v.empty()) fwrite(&v[0], sizeof(T), v.size(), fw);
+}
+
+bool load_cache(const char *prefix_fn, bool with_mcl, const char *m8_fn)
+/* fill in the data from prefix.cache, false if it is missing or stale */
+{
+    char fn[LABEL_LEN];
+    Cache_header cur, h;
+    struct stat st;
+    char *data;
+    int fd, i, n;
+
+    name_file(fn, "%s.cache", prefix_fn);
+    if ((fd = open(fn, O_RDONLY)) < 0) return false;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(Cache_header))
+    {
+        close(fd);
+        return false;
+    }
+    data = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == (char *) MAP_FAILED) return false;
+
+    Cache_cursor c;
+    c.p = data, c.end = data + st.st_size, c.ok = true;
+    memset(&h, 0, sizeof(Cache_header));
+    get(c, &h, sizeof(Cache_header));
+    make_header(prefix_fn, with_mcl, m8_fn, &cur);
+    if (!c.ok || memcmp(&h, &cur, sizeof(Cache_header)) != 0)
+    {
+        munmap(data, st.st_size);
+        progress("%s is out of date, reading the text files", fn);
+        return false;
+    }
+
+    /* chromosomes */
+    n = get_int(c);
+    mol_list.resize(n);
+    for (i=0; i<n && c.ok; i++) get_string(c, mol_list[i]);
+
+    /* genes, stored as (mol, mid, node) plus the name */
+    vector<int> cols;
+    get_vector(c, cols);
+    n = cols.size() / 3;
+    gene_list.resize(n);
+    for (i=0; i<n && c.ok; i++)
+    {
+        gene_list[i].mol = cols[3*i];
+        gene_list[i].mid = cols[3*i+1];
+        gene_list[i].node = cols[3*i+2];
+        get_string(c, gene_list[i].name);
+    }
+
+    /* matches and the per-pair index */
+    get_vector(c, match_list.gene1);
+    get_vector(c, match_list.gene2);
+    get_vector(c, match_list.score);
+    n = get_int(c);
+    pair_list.resize(n);
+    for (i=0; i<n && c.ok; i++) get_string(c, pair_list[i]);
+    get_vector(c, pair_offsets);
+    munmap(data, st.st_size);
+
+    n = match_list.gene1.size();
+    if (!c.ok || c.p != c.end || (int) match_list.gene2.size() != n ||
+        (int) match_list.score.size() != n ||
+        pair_offsets.size() != pair_list.size()+1 || pair_offsets.back() != n)
+    {
+        warn("%s is corrupted, reading the text files", fn);
+        gene_list.clear(), mol_list.clear(), match_list.clear();
+        pair_list.clear(), pair_offsets.clear();
+        return false;
+    }
+
+    /* everything else is derived */
+    index_genes();
+    mol_pairs.clear();
+    for (i=0; i<(int) pair_list.size(); i++) mol_pairs[pair_list[i]] = i;
+    chr_map.assign(mol_list.size(), geneSet());
+    n = gene_list.size();
+    for (i=0; i<n; i++)
+    {
+        // only genes in the mcl file have a node
+        if (gene_list[i].node >= 0)
+            chr_map[gene_list[i].mol].insert(&gene_list[i]);
+    }
+
+    progress("%d genes, %d matches loaded from %s",
+             (int) gene_list.size(), (int) match_list.size(), fn);
+    return true;
+}
+
+bool save_cache(const char *prefix_fn, bool with_mcl, const char *m8_fn)
+/* write the data read from the text files to prefix.cache, false with
+ * load_error set if it can't be written */
+{
+    char fn[LABEL_LEN], tmp_fn[LABEL_LEN+4];
+    Cache_header h;
+    int i, n;
+
+    name_file(fn, "%s.cache", prefix_fn);
+    sprintf(tmp_fn, "%s.tmp", fn);
+    FILE *fw = fopen(tmp_fn, "wb");
+    if (fw == NULL)
+        return input_error("Can't open %s to write: %s", tmp_fn,
+                           strerror(errno));
+
+    make_header(prefix_fn, with_mcl, m8_fn, &h);
+    fwrite(&h, sizeof(Cache_header), 1, fw);
+
+    n = mol_list.size();
+    put_int(fw, n);
+    for (i=0; i<n; i++) put_string(fw, mol_list[i]);
+
+    vector<int> cols;
+    n = gene_list.size();
+    for (i=0; i<n; i++)
+    {
+        cols.push_back(gene_list[i].mol);
+        cols.push_back(gene_list[i].mid);
+        cols.push_back(gene_list[i].node);
+    }
+    put_vector(fw, cols);
+    for (i=0; i<n; i++) put_string(fw, gene_list[i].name);
+
+    put_vector(fw, match_list.gene1);
+    put_vector(fw, match_list.gene2);
+    put_vector(fw, match_list.score);
+    n = pair_list.size();
+    put_int(fw, n);
+    for (i=0; i<n; i++) put_string(fw, pair_list[i]);
+    put_vector(fw, pair_offsets);
+
+    if (ferror(fw) | fclose(fw))
+    {
+        input_error("Can't write %s: %s", tmp_fn, strerror(errno));
+        unlink(tmp_fn);
+        return false;
+    }
+    if (rename(tmp_fn, fn) < 0)
+    {
+        input_error("Can't rename %s: %s", tmp_fn, strerror(errno));
+        unlink(tmp_fn);
+        return false;
+    }
+    progress("input cached in %s", fn);
+    return true;
+}
@@ -0,0 +1,17 @@
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include "basic.h"
+#include "line_reader.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool load_cache(const char *prefix_fn, bool with_mcl, const char *m8_fn);
+bool save_cache(const char *prefix_fn, bool with_mcl, const char *m8_fn);
+
+// read_data
+extern void index_genes();
+
+#endif
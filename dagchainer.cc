@@ -22,21 +22,146 @@ static bool check_overlap(vector<int>& xx, vector<int>& yy)
     return xmin <= ymax && ymin <= xmax;
 }
 
-static void retrieve_pos(int pid, int *pos1, int *pos2)
-/* returns pos1, pos2 for the blast pair */
+/* Anchors still in play, counted by box. A merge sort tree over the x
+ * order: level L sorts the y of each block of 2^L positions and keeps a
+ * Fenwick tree per block of the anchors not removed yet, so both counting a
+ * box and removing an anchor cost O(log^2 n). Anchors with the same y in a
+ * block are interchangeable, a removal is taken off the first of its run
+ * and boxes never split a run. Building the tree costs about as much as
+ * 16 plain scans per level, so boxes are counted by scanning until that
+ * many have been asked for; pairs with few blocks never pay for it */
+struct Range_count
 {
-    Blast_record *match_rec = &match_list[pid];
+    int n, size, levels, scans;
+    bool built;
+    vector<int> at;  // tree position of each anchor in score
+    vector<int> xs, ys;
+    vector< vector<int> > sorted;
+    vector< vector<int> > alive;
+
+    void init(int num)
+    {
+        for (size=1, levels=1; size<num; size<<=1, levels++) ;
+        scans = 0;
+        built = false;
+    }
+    int count(const vector<Score_t> &score, int x1, int x2, int y1, int y2)
+    /* anchors in score with x1 <= x <= x2 and y1 <= y <= y2 */
+    {
+        if (!built && ++scans > 16*levels) build(score);
+        if (built) return query(x1, x2, y1, y2);
 
-    *pos1 = gene_map[match_rec->gene1].mid;
-    *pos2 = gene_map[match_rec->gene2].mid;
-}
+        int c = 0;
+        vector<Score_t>::const_iterator it;
+        for (it=score.begin(); it!=score.end(); it++)
+        {
+            if (it->x >=x1 && it->x <=x2 && it->y >=y1 && it->y <=y2)
+                c++;
+        }
+        return c;
+    }
+    void compact(const vector<int> &new_id)
+    /* score dropped the anchors with new_id < 0 and moved the others */
+    {
+        int i, m = new_id.size(), kept = 0;
+        if (!built) return;
+        for (i=0; i<m; i++)
+        {
+            if (new_id[i] < 0) remove(at[i]);
+            else at[new_id[i]] = at[i], kept++;
+        }
+        at.resize(kept);
+    }
+
+private:
+    void build(const vector<Score_t> &score)
+    {
+        int i, L, w;
+        built = true;
+        n = score.size();
+        at.resize(n);
+        for (i=0; i<n; i++) at[i] = i;
+        xs.resize(n), ys.resize(n);
+        for (i=0; i<n; i++) xs[i] = score[i].x, ys[i] = score[i].y;
+
+        for (size=1, levels=1; size<n; size<<=1, levels++) ;
+        sorted.resize(levels);
+        alive.resize(levels);
+        sorted[0].resize(n);
+        sorted[0] = ys;
+        for (L=1; L<levels; L++)
+        {
+            sorted[L].resize(n);
+            for (i=0, w=1<<(L-1); i<n; i+=2*w)
+                merge(sorted[L-1].begin()+i,
+                      sorted[L-1].begin()+MIN(i+w, n),
+                      sorted[L-1].begin()+MIN(i+w, n),
+                      sorted[L-1].begin()+MIN(i+2*w, n),
+                      sorted[L].begin()+i);
+        }
+        /* all alive, so Fenwick entry j of a block holds lowbit(j) */
+        for (L=0; L<levels; L++)
+        {
+            alive[L].resize(n);
+            for (i=0; i<n; i++)
+            {
+                w = (i & ((1<<L)-1)) + 1;
+                alive[L][i] = w & -w;
+            }
+        }
+    }
+    void remove(int pos)
+    {
+        int L, b, e, j;
+        for (L=0; L<levels; L++)
+        {
+            b = pos >> L << L, e = MIN(b + (1<<L), n);
+            j = lower_bound(sorted[L].begin()+b, sorted[L].begin()+e,
+                            ys[pos]) - sorted[L].begin() - b;
+            for (j++; b+j<=e; j+=j & -j) alive[L][b+j-1]--;
+        }
+    }
+    int query(int x1, int x2, int y1, int y2) const
+    /* anchors left with x1 <= x <= x2 and y1 <= y <= y2 */
+    {
+        int lo = lower_bound(all(xs), x1) - xs.begin();
+        int hi = upper_bound(all(xs), x2) - xs.begin();
+        int L, c = 0;
 
-static bool is_significant(Seg_feat *sf, vector<Score_t>& score)
-/* test if a syntenic block is significant, see description in permutation.cc */
+        if (y1 > y2) return 0;
+        for (L=0; lo<hi; L++, lo>>=1, hi>>=1)
+        {
+            if (lo & 1) c += in_block(L, lo++, y1, y2);
+            if (hi & 1) c += in_block(L, --hi, y1, y2);
+        }
+        return c;
+    }
+    int in_block(int L, int blk, int y1, int y2) const
+    /* anchors left in block blk of level L with y1 <= y <= y2 */
+    {
+        int b = blk << L, e = MIN(b + (1<<L), n);
+        vector<int>::const_iterator first = sorted[L].begin();
+        int j = upper_bound(first+b, first+e, y2) - first - b;
+        int i = lower_bound(first+b, first+e, y1) - first - b;
+        return alive_below(L, b, j) - alive_below(L, b, i);
+    }
+    int alive_below(int L, int b, int j) const
+    /* anchors left among the first j entries of the block at b */
+    {
+        int c = 0;
+        for (; j>0; j-=j & -j) c += alive[L][b+j-1];
+        return c;
+    }
+};
+
+static bool is_significant(Seg_feat *sf, const vector<Score_t>& score,
+                           const vector<int> &ans, Range_count &rc)
+/* test if a syntenic block is significant, see description in permutation.cc;
+ * ans lists the anchors of the block in score */
 {
     /* see formula in permutation.cc, unknowns are m, N, L1, L2, l_1i l_2i*/
-    int s1_a, s1_b, s2_a, s2_b, m, N=0, L1, L2, i;
-    double l1, l2, summation=0;
+    int s1_a, s1_b, s2_a, s2_b, m, N=0, L1, L2;
+    double summation;
 
     /* get the start and stop coordinates on each syntenic segment */
     s1_a = sf->s1->mid, s1_b = sf->t1->mid;
@@ -46,26 +171,11 @@ static bool is_significant(Seg_feat *sf, vector<Score_t>& score)
     m = sf->pids.size();
 
     /* calculate N, number of matches in the defined region*/
-    vector<Score_t>::const_iterator it;
-    for (it=score.begin(); it!=score.end(); it++)
-    {
-        if (it->x >=s1_a && it->x <=s1_b && it->y >=s2_a && it->y <=s2_b)
-            N++;
-    }
+    N = rc.count(score, s1_a, s1_b, s2_a, s2_b);
 
-    /* calculate l1, l2, distance between successive anchor points */
-    int l1_pos1, l1_pos2, l2_pos1, l2_pos2;
-    retrieve_pos(sf->pids[0], &l1_pos1, &l2_pos1);
-    for (i=1; i<m; i++)
-    {
-        retrieve_pos(sf->pids[i], &l1_pos2, &l2_pos2);
-        l1 = fabs(l1_pos2 - l1_pos1);
-        l2 = fabs(l2_pos2 - l2_pos1);
-        l1_pos1 = l1_pos2;
-        l2_pos1 = l2_pos2;
-
-        summation += log(l1)+log(l2);
-    }
+    /* calculate l1, l2, distance between successive anchor points, the
+     * reverse pass mirrors y which leaves the distances as they are */
+    summation = ln_spacing(score, ans);
 
     /* calculate L1, L2, respective length of the matching region */
     L1 = s1_b - s1_a, L2 = s2_b - s2_a;
@@ -90,61 +200,251 @@ static bool check_self (const string &s)
     return s.substr(0, pos) == s.substr(pos+1);
 }
 
-static void print_chains(vector<Score_t>& score, const string &mol_pair)
-/* Find and output highest scoring chains in score treating it as a DAG*/
+static void chain_classic(const vector<Score_t>& score,
+                          vector<float> &path_score, vector<int> &from,
+                          const vector<char> &redo, Chain_count *cnt)
+/* the original DAGchainer recurrence, scans back over all predecessors
+ * until both distances exceed EXTENSION_DIST; only anchors flagged in redo
+ * are chained, the others keep their path_score and from */
 {
-    vector<float> path_score;
-    vector<int> from, ans;
-    vector<Path_t> high;
-    vector<int> xx, yy;
-    Path_t  p;
-    bool done;
-    int i, j, m, n, s, pid, num_gaps;
+    int i, j, n = score.size(), num_gaps;
     int del_x, del_y;
+    long steps = 0;
     double x;
-    bool is_self = check_self(mol_pair);
 
-    sort(score.begin(), score.end());
-
-    do
+    for (j=1; j<n; j++)
     {
-        done = true;
-        n = score.size();
-        path_score.resize(n);
-        from.resize(n);
-        for (i=0; i<n; i++)
-        {
-            path_score[i] = score[i].score;
-            from[i] = -1;
-        }
-        for (j=1; j<n; j++)
+        if (!redo[j]) continue;
+        for (i=j-1; i>=0; i--)
         {
-            for (i=j-1; i>=0; i--)
+            steps++;
+            del_x = score[j].x - score[i].x - 1;
+            del_y = score[j].y - score[i].y - 1;
+
+            if  (del_x >= 0 && del_y >= 0)
             {
-                del_x = score[j].x - score[i].x - 1;
-                del_y = score[j].y - score[i].y - 1;
+                if (del_x > EXTENSION_DIST && del_y > EXTENSION_DIST)
+                    break;
+                if (del_x > EXTENSION_DIST || del_y > EXTENSION_DIST)
+                    continue;
+
+                num_gaps = MAX(del_x, del_y)/UNIT_DIST;
 
-                if  (del_x >= 0 && del_y >= 0)
+                x = path_score[i] + score[j].score;
+                /* gap penalty */
+                if (num_gaps > 0) x -= num_gaps;
+
+                if  (x > path_score[j])
                 {
-                    if (del_x > EXTENSION_DIST && del_y > EXTENSION_DIST)
-                        break;
-                    if (del_x > EXTENSION_DIST || del_y > EXTENSION_DIST)
-                        continue;
+                    path_score[j] = x;
+                    from[j] = i;
+                }
+            }
+        }
+    }
+    cnt->steps += steps;
+}
+
+/* Range maximum over anchors, a key packs the path score of an anchor with
+ * its index, so the maximum prefers the higher score and then the later
+ * anchor, which is the one the classic backward scan settles on */
+#define EMPTY_KEY LONG_MIN
 
-                    num_gaps = MAX(del_x, del_y)/UNIT_DIST;
+struct Max_tree
+{
+    int size;
+    vector<long> t;
 
-                    x = path_score[i] + score[j].score;
-                    /* gap penalty */
-                    if (num_gaps > 0) x -= num_gaps;
+    void init(int n)
+    {
+        for (size=1; size<n; size<<=1) ;
+        t.assign(2*size, EMPTY_KEY);
+    }
+    void set(int leaf, long key)
+    {
+        int k = leaf + size;
+        for (t[k]=key, k>>=1; k>0; k>>=1) t[k] = MAX(t[2*k], t[2*k+1]);
+    }
+    long query(int lo, int hi) const
+    /* maximum over leaves [lo, hi) */
+    {
+        long best = EMPTY_KEY;
+        for (lo+=size, hi+=size; lo<hi; lo>>=1, hi>>=1)
+        {
+            if (lo&1) best = MAX(best, t[lo]), lo++;
+            if (hi&1) hi--, best = MAX(best, t[hi]);
+        }
+        return best;
+    }
+};
 
-                    if  (x > path_score[j])
-                    {
-                        path_score[j] = x;
-                        from[j] = i;
-                    }
+struct yOrder
+{
+    const vector<Score_t> *s;
+    bool operator() (int a, int b) const
+    {
+        return (*s)[a].y < (*s)[b].y || ((*s)[a].y == (*s)[b].y && a < b);
+    }
+};
+
+static void slide_band(Max_tree &t, int &first, int &last, int x_min, int j,
+                       const vector<Score_t>& score,
+                       const vector<float> &path_score, const vector<int> &leaf)
+/* move a band's window to the anchors [first, j) with x >= x_min; bands
+ * are only caught up when queried, so anchors that pass through a window
+ * unqueried are never entered */
+{
+    for (; first<last && score[first].x < x_min; first++)
+        t.set(leaf[first], EMPTY_KEY);
+    if (first == last)
+    {
+        while (first < j && score[first].x < x_min) first++;
+        last = first;
+    }
+    for (; last<j; last++)
+        t.set(leaf[last], (long) path_score[last] * 4294967296L + last);
+}
+
+static void chain_sparse(const vector<Score_t>& score,
+                         vector<float> &path_score, vector<int> &from,
+                         const vector<char> &redo, Chain_count *cnt)
+/* same recurrence as chain_classic in O(n G log n), G=EXTENSION_DIST/UNIT_DIST+1
+ *
+ * A predecessor whose larger distance is d costs d/UNIT_DIST, so the gap
+ * penalty g is constant within the square of radius d_g=(g+1)*UNIT_DIST-1
+ * (capped at EXTENSION_DIST) minus the one inside it. Taking the maximum
+ * over the whole square and subtracting g never overrates an anchor, it
+ * only charges anchors of the inner squares more than their own penalty,
+ * so the best over all g is the exact answer. The anchors are swept by x,
+ * band g keeps the ones within d_g in x in a max tree over y order.
+ * The G trees take 16*G bytes per anchor, so the Engine only picks this
+ * for G <= SPARSE_MAX_BANDS. */
+{
+    int n = score.size(), G = EXTENSION_DIST/UNIT_DIST + 1;
+    int i, j, k, g, lo, hi, X;
+    long key, steps = 0;
+    double x;
+
+    /* leaves in y order */
+    vector<int> by_y(n), leaf(n), ys(n);
+    yOrder cmp;
+    cmp.s = &score;
+    for (i=0; i<n; i++) by_y[i] = i;
+    sort(by_y.begin(), by_y.end(), cmp);
+    for (i=0; i<n; i++)
+    {
+        leaf[by_y[i]] = i;
+        ys[i] = score[by_y[i]].y;
+    }
+
+    vector<int> d(G), first(G, 0), last(G, 0);
+    vector<Max_tree> band(G);
+    for (g=0; g<G; g++)
+    {
+        d[g] = MIN((g+1)*UNIT_DIST-1, EXTENSION_DIST);
+        band[g].init(n);
+    }
+
+    for (j=0; j<n; j=k)
+    {
+        /* anchors sharing this x are not predecessors of each other */
+        X = score[j].x;
+        for (k=j; k<n && score[k].x == X; k++) ;
+
+        for (i=j; i<k; i++)
+        {
+            long best_key = EMPTY_KEY, top;
+            double best = 0;
+
+            if (!redo[i]) continue;
+
+            /* the widest square bounds every band, so the scan can stop
+             * once the remaining penalties rule out even its best anchor */
+            hi = upper_bound(ys.begin(), ys.end(),
+                             score[i].y-1) - ys.begin();
+            lo = lower_bound(ys.begin(), ys.end(),
+                             score[i].y-1-d[G-1]) - ys.begin();
+            if (lo >= hi) continue;
+            slide_band(band[G-1], first[G-1], last[G-1], X-1-d[G-1], j,
+                       score, path_score, leaf);
+            top = band[G-1].query(lo, hi);
+            steps++;
+            if (top == EMPTY_KEY) continue;
+
+            for (g=0; g<G; g++)
+            {
+                x = path_score[top & 0xffffffffL] + score[i].score;
+                if (best_key != EMPTY_KEY && x - g < best) break;
+                if (g < G-1)
+                {
+                    slide_band(band[g], first[g], last[g], X-1-d[g], j,
+                               score, path_score, leaf);
+                    lo = lower_bound(ys.begin(), ys.begin()+hi,
+                                     score[i].y-1-d[g]) - ys.begin();
+                    if (lo >= hi) continue;
+                    key = band[g].query(lo, hi);
+                    steps++;
+                    if (key == EMPTY_KEY) continue;
                 }
+                else key = top;
+
+                int p = key & 0xffffffffL;
+                x = path_score[p] + score[i].score;
+                x -= g;
+                if (best_key == EMPTY_KEY || x > best ||
+                        (x == best && p > (best_key & 0xffffffffL)))
+                    best = x, best_key = key;
+            }
+            if (best_key != EMPTY_KEY && best > path_score[i])
+            {
+                path_score[i] = best;
+                from[i] = best_key & 0xffffffffL;
             }
         }
+    }
+    cnt->steps += steps;
+}
+
+static void print_chains(vector<Score_t>& score, const Match_store &ms,
+                         const string &mol_pair, vector<Seg_feat> &segs,
+                         Chain_count *cnt)
+/* Find and output highest scoring chains in score treating it as a DAG,
+ * the pairIDs of score index ms */
+{
+    vector<float> path_score;
+    vector<int> from, ans;
+    vector<Path_t> high;
+    vector<int> xx, yy;
+    vector<int> new_id;
+    vector<char> redo;
+    Range_count rc;
+    Path_t  p;
+    bool done;
+    int i, j, k, m, n, s, pid;
+    bool is_self = check_self(mol_pair);
+
+    radix_sort(score);
+
+    n = score.size();
+    rc.init(n);
+    path_score.resize(n);
+    from.resize(n);
+    for (i=0; i<n; i++)
+    {
+        path_score[i] = score[i].score;
+        from[i] = -1;
+    }
+    redo.assign(n, 1);
+    cnt->done += n;
+
+    do
+    {
+        done = true;
+        n = score.size();
+        cnt->full += n;
+        cnt->passes++;
+        if (SPARSE_CHAIN) chain_sparse(score, path_score, from, redo, cnt);
+        else chain_classic(score, path_score, from, redo, cnt);
 
         high.clear();
         for (i=0; i<n; i++)
@@ -191,7 +491,6 @@ static void print_chains(vector<Score_t>& score, const string &mol_pair)
                     }
 
                     Seg_feat sf;
-                    Blast_record *br;
                     if (!(is_self && check_overlap(xx, yy)))
                     {
                         sf.score = path_score[high[i].sub];
@@ -200,16 +499,15 @@ static void print_chains(vector<Score_t>& score, const string &mol_pair)
                             from[ans[j]] = -2;
 
                             pid = score[ans[j]].pairID;
-                            br = &match_list[pid];
                             sf.pids.push_back(pid);
                         }
                         /* start and stop positions for two sub-segments */
-                        br = &match_list[sf.pids.front()];
-                        sf.s1 = &gene_map[br->gene1];
-                        sf.s2 = &gene_map[br->gene2];
-                        br = &match_list[sf.pids.back()];
-                        sf.t1 = &gene_map[br->gene1];
-                        sf.t2 = &gene_map[br->gene2];
+                        pid = sf.pids.front();
+                        sf.s1 = &gene_list[ms.gene1[pid]];
+                        sf.s2 = &gene_list[ms.gene2[pid]];
+                        pid = sf.pids.back();
+                        sf.t1 = &gene_list[ms.gene1[pid]];
+                        sf.t2 = &gene_list[ms.gene2[pid]];
 
                         /* determine the orientation of the alignment */
                         sf.sameStrand = *(sf.s2) < *(sf.t2);
@@ -218,8 +516,11 @@ static void print_chains(vector<Score_t>& score, const string &mol_pair)
                         sf.mol_pair = mol_pair;
 
                         /* significance testing */
-                        if (is_significant(&sf, score))
-                            seg_list.push_back(sf);
+                        long start = clock_us();
+                        if (is_significant(&sf, score, ans, rc))
+                            segs.push_back(sf);
+                        cnt->tests++;
+                        cnt->test_us += clock_us() - start;
                     }
                     xx.clear(), yy.clear();
                 }
@@ -228,33 +529,58 @@ static void print_chains(vector<Score_t>& score, const string &mol_pair)
 
         if (!done)
         {
+            /* dropping anchors only lowers the scores, so an anchor whose
+             * chain avoids all of them keeps its score and predecessor;
+             * the rest are chained again in the next pass */
+            new_id.assign(n, -1);
+            for (i=j=0; i<n; i++)
+                if (from[i] != -2) new_id[i] = j++;
+
+            redo.assign(j, 0);
             for (i=j=0; i<n; i++)
             {
-                if (from[i] != -2)
+                if (from[i] == -2) continue;
+                k = from[i];
+                score[j] = score[i];
+                if (k >= 0 && (new_id[k] < 0 || redo[new_id[k]]))
+                {
+                    path_score[j] = score[j].score;
+                    from[j] = -1;
+                    redo[j] = 1;
+                    cnt->done++;
+                }
+                else
                 {
-                    if (i!=j) score[j] = score[i];
-                    j++;
+                    path_score[j] = path_score[i];
+                    from[j] = k >= 0 ? new_id[k] : -1;
                 }
+                j++;
             }
             score.resize(j);
+            rc.compact(new_id);
+            path_score.resize(j);
+            from.resize(j);
         }
     }
     while (!done);
 }
 
-void dag_main(vector<Score_t> &score, const string &mol_pair)
+void dag_main(vector<Score_t> &score, const Match_store &ms,
+              const string &mol_pair, vector<Seg_feat> &segs,
+              Chain_count *cnt)
 {
     int i, n=score.size();
 
     // should be sorted by y incremental
-    Max_Y = score[n-1].y;
+    int Max_Y = score[n-1].y;
     // forward direction
-    print_chains(score, mol_pair);
+    print_chains(score, ms, mol_pair, segs, cnt);
     // reverse complement the second coordinate set.
+    n = score.size();
     for (i=0; i<n; i++)
         score[i].y = Max_Y - score[i].y + 1;
     // reverse direction
-    print_chains(score, mol_pair);
+    print_chains(score, ms, mol_pair, segs, cnt);
 
     score.clear();
 }
@@ -3,15 +3,14 @@
 
 #include  "basic.h"
 
-void dag_main(vector<Score_t> &score, const string &mol_pair);
-
-// segment id, plus one when found a pairwise alignment
-int ali_ct = 0;
-int Best_g = -1, Best_i, Best_j;
-int Max_Y;
+void dag_main(vector<Score_t> &score, const Match_store &ms,
+              const string &mol_pair,
+              vector<Seg_feat> &segs, Chain_count *cnt);
 
 /* calculation procedure in permutation.cc */
 extern double ln_perm(int n, int r);
 extern double ln_comb(int n, int k);
+extern double ln_spacing(const vector<Score_t> &score,
+                         const vector<int> &ans);
 
 #endif
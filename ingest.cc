@@ -0,0 +1,285 @@
+/*
+ * Reads the raw 12-column BLAST -m8 output directly, replacing the
+ * cut -f 1,2,11 | filter_blast.py | read_blast pipeline
+ *
+ * Every hit between two genes in the .bed file is ordered lexically
+ * (self hits dropped) and routed by a hash of the gene pair to one of
+ * NUM_THREADS partitions, each partition then keeps the best (least)
+ * e-value of every pair on its own thread. The hits of a partition are
+ * already reduced to one per pair whenever their bucket fills up, so the
+ * memory follows the unique gene pairs rather than the raw hits. The
+ * surviving pairs go into match_list in the same order and with the same
+ * e-values (printed with %g by filter_blast.py) that read_blast gives
+ * for the filtered file.
+ */
+
+#include "ingest.h"
+
+// hits a bucket takes before it is first deduplicated
+#define BUCKET_MIN (1 << 16)
+// inflated text parsed per thread in each round of a .gz file
+#define GZ_SLICE (1 << 22)
+
+struct M8_hit
+{
+    int r1, r2;  // name ranks of the two genes, r1 < r2
+    double e;
+    bool operator < (const M8_hit &h) const
+    {
+        return r1 < h.r1 || (r1 == h.r1 && (r2 < h.r2 ||
+                                            (r2 == h.r2 && e < h.e)));
+    }
+};
+typedef vector<M8_hit> hitVec;
+
+struct Ingest_state
+{
+    Line_reader fp;
+    int nparts;
+    // gene id to the rank of its name, and back
+    vector<int> rank, by_rank;
+    // text handed to each parsing thread, bounds[0] is on line first_line
+    vector<const char *> bounds;
+    long first_line;
+    // hits found by thread t for partition p are in buckets[t*nparts+p],
+    // deduplicated again once they reach limits[t*nparts+p]
+    vector<hitVec> buckets;
+    vector<size_t> limits;
+    vector<long> records;
+    // first malformed line of each slice and why, NULL if none
+    vector<long> bad_line;
+    vector<const char *> bad_msg;
+    // deduplicated and sorted hits of every partition
+    vector<hitVec> parts;
+};
+
+static bool nameCmp(int a, int b)
+{
+    return gene_list[a].name < gene_list[b].name;
+}
+
+static void compact_hits(hitVec &h)
+/* sort h and keep the least e-value of every pair */
+{
+    int i, j, n = h.size();
+    sort(all(h));
+    for (i=j=0; i<n; i++)
+    {
+        if (j > 0 && h[j-1].r1 == h[i].r1 && h[j-1].r2 == h[i].r2) continue;
+        h[j++] = h[i];
+    }
+    h.resize(j);
+}
+
+static const char *parse_hit(Ingest_state *st, int t,
+                             const char *line, const char *end)
+/* route one m8 line to its partition, returns an error message if the
+ * line is malformed */
+{
+    const char *q, *s, *ev, *tok;
+    int lenq, lens, lenev, len, i, id1, id2, r1, r2;
+    double e;
+
+    if (!next_token(line, end, q, lenq) || *q == '#') return NULL;
+    st->records[t]++;
+    // e-value is the 11th column
+    if (!next_token(line, end, s, lens)) return "expected 12 columns";
+    for (i=3; i<11; i++)
+        if (!next_token(line, end, tok, len)) return "expected 12 columns";
+    if (!next_token(line, end, ev, lenev) || !parse_double(ev, lenev, &e))
+        return "bad e-value in column 11";
+
+    if ((id1 = find_gene(q, lenq)) < 0 || (id2 = find_gene(s, lens)) < 0)
+        return NULL;
+    // swap lexically and ignore self match
+    r1 = st->rank[id1], r2 = st->rank[id2];
+    if (r1 == r2) return NULL;
+    if (r1 > r2) swap(r1, r2);
+
+    M8_hit h;
+    h.r1 = r1, h.r2 = r2, h.e = e;
+    unsigned int p = ((unsigned int) r1 * 2654435761u ^ (unsigned int) r2)
+                     % st->nparts;
+    hitVec &b = st->buckets[t*st->nparts + p];
+    size_t &limit = st->limits[t*st->nparts + p];
+    b.push_back(h);
+    if (b.size() >= limit)
+    {
+        // twice what is left, so every hit is sorted O(log) times
+        compact_hits(b);
+        limit = MAX(2*b.size(), (size_t) BUCKET_MIN);
+    }
+    return NULL;
+}
+
+static void parse_job(int t, int thread, void *arg)
+/* parse the lines between bounds[t] and bounds[t+1], up to the first
+ * malformed one */
+{
+    Ingest_state *st = (Ingest_state *) arg;
+    const char *p = st->bounds[t], *stop = st->bounds[t+1], *nl, *msg;
+
+    for (; p < stop; p = nl+1)
+    {
+        nl = (const char *) memchr(p, '\n', stop-p);
+        if (!nl) nl = stop;
+        if ((msg = parse_hit(st, t, p, nl)) != NULL)
+        {
+            st->bad_msg[t] = msg;
+            st->bad_line[t] = st->first_line +
+                              (long) count(st->bounds[0], p, '\n');
+            return;
+        }
+    }
+}
+
+static bool parse_slices(Ingest_state &st, int nthreads)
+/* parse the slices cut by cut_slices(), false with load_error set on the
+ * first malformed line in file order */
+{
+    int t;
+    st.bad_msg.assign(nthreads, NULL);
+    st.bad_line.assign(nthreads, 0);
+    parallel_run(nthreads, NUM_THREADS, parse_job, &st);
+    for (t=0; t<nthreads; t++)
+        if (st.bad_msg[t])
+            return input_error("%s:%ld: %s", st.fp.fn.c_str(),
+                               st.bad_line[t], st.bad_msg[t]);
+    return true;
+}
+
+static void dedup_job(int p, int thread, void *arg)
+/* collect partition p from all threads, keep the least e-value per pair */
+{
+    Ingest_state *st = (Ingest_state *) arg;
+    hitVec &h = st->parts[p];
+    int t, nthreads = st->records.size();
+
+    for (t=0; t<nthreads; t++)
+    {
+        hitVec &b = st->buckets[t*st->nparts + p];
+        h.insert(h.end(), all(b));
+        hitVec().swap(b);
+    }
+    compact_hits(h);
+}
+
+static void cut_slices(Ingest_state &st, const char *data, size_t len,
+                       int nthreads)
+/* bounds of nthreads slices of the text, cut at line breaks */
+{
+    const char *stop = data + len, *p;
+    int t;
+
+    st.bounds.clear();
+    st.bounds.push_back(data);
+    for (t=1; t<nthreads; t++)
+    {
+        p = data + len / nthreads * t;
+        if (p < st.bounds.back()) p = st.bounds.back();
+        while (p < stop && *p != '\n') p++;
+        st.bounds.push_back(p < stop ? p+1 : stop);
+    }
+    st.bounds.push_back(stop);
+}
+
+bool ingest_m8(const char *m8_fn, bool gff_flag)
+/* false with load_error set if the file can't be read or is malformed */
+{
+    Ingest_state st;
+    const char *line, *end;
+    int i, n, t, nthreads, selected_num = 0;
+    long total_num = 0;
+    bool ok = true;
+
+    if (!st.fp.open(m8_fn)) return false;
+    long start = clock1000();
+
+    n = gene_list.size();
+    st.by_rank.resize(n);
+    st.rank.resize(n);
+    for (i=0; i<n; i++) st.by_rank[i] = i;
+    sort(all(st.by_rank), nameCmp);
+    for (i=0; i<n; i++) st.rank[st.by_rank[i]] = i;
+
+    /* a mapped file is cut into one slice per thread at line breaks; a
+     * compressed one is gathered as it is inflated, GZ_SLICE bytes per
+     * thread, and every such batch is cut the same way */
+    st.nparts = nthreads = NUM_THREADS;
+    st.buckets.resize(nthreads*st.nparts);
+    st.limits.assign(nthreads*st.nparts, BUCKET_MIN);
+    st.records.assign(nthreads, 0);
+    if (st.fp.gz)
+    {
+        string batch;
+        bool eof = false;
+        while (!eof && ok)
+        {
+            batch.clear();
+            st.first_line = st.fp.line_no + 1;
+            while (batch.size() < (size_t) nthreads*GZ_SLICE)
+            {
+                if (!st.fp.next(line, end))
+                {
+                    eof = true;
+                    break;
+                }
+                batch.append(line, end-line);
+                batch += '\n';
+            }
+            if (st.fp.bad) break;
+            cut_slices(st, batch.data(), batch.size(), nthreads);
+            ok = parse_slices(st, nthreads);
+        }
+    }
+    else
+    {
+        st.first_line = 1;
+        cut_slices(st, st.fp.data, st.fp.len, nthreads);
+        ok = parse_slices(st, nthreads);
+    }
+    if (!ok || st.fp.bad)
+    {
+        st.fp.close();
+        return false;
+    }
+    for (t=0; t<nthreads; t++) total_num += st.records[t];
+
+    st.parts.resize(st.nparts);
+    parallel_run(st.nparts, NUM_THREADS, dedup_job, &st);
+
+    /* the partitions are sorted by name, merge them pairwise */
+    for (n=1; n<st.nparts; n*=2)
+    {
+        for (i=0; i+n<st.nparts; i+=2*n)
+        {
+            hitVec merged;
+            merged.reserve(st.parts[i].size() + st.parts[i+n].size());
+            merge(all(st.parts[i]), all(st.parts[i+n]),
+                  back_inserter(merged));
+            st.parts[i].swap(merged);
+            hitVec().swap(st.parts[i+n]);
+        }
+    }
+    hitVec &hits = st.parts[0];
+    n = hits.size();
+
+    char buf[LABEL_LEN];
+    for (i=0; i<n; i++)
+    {
+        // same e-value as written out and read back by filter_blast.py
+        sprintf(buf, "%g", hits[i].e);
+        if (add_match(st.by_rank[hits[i].r1], st.by_rank[hits[i].r2],
+                      strtod(buf, NULL), gff_flag)) selected_num++;
+    }
+
+    progress("%ld records read, %d unique gene pairs", total_num, n);
+    progress("%d matches imported (%d discarded)",
+             selected_num, n - selected_num);
+    double elapsed = MAX(clock1000() - start, 1)/1000.;
+    progress("%s: %.1f MB ingested [%.1f MB/s]", m8_fn,
+             st.fp.size/1e6, st.fp.size/1e6/elapsed);
+    st.fp.close();
+
+    return index_pairs();
+}
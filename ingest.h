@@ -0,0 +1,15 @@
+#ifndef __INGEST_H
+#define __INGEST_H
+
+#include "basic.h"
+#include "line_reader.h"
+#include <iterator>
+
+bool ingest_m8(const char *m8_fn, bool gff_flag=true);
+
+// read_data
+extern int find_gene(const char *name, int len);
+extern bool add_match(int id1, int id2, double score, bool gff_flag);
+extern bool index_pairs();
+
+#endif
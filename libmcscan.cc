@@ -0,0 +1,460 @@
+/*
+ * Library interface of MCSCAN, see libmcscan.h
+ *
+ * Owns the globals of basic.h, which hold the context of the call in
+ * progress
+ */
+
+#include "mcscan.h"
+#include "libmcscan.h"
+
+/***** Instantiate all data *****/
+vector<Gene_feat> gene_list;
+vector<string> mol_list;
+Match_store match_list;
+vector<Seg_feat> seg_list;
+map<string, int> mol_pairs;
+vector<string> pair_list;
+vector<int> pair_offsets;
+vector<geneSet> chr_map;
+Spill_index spill_index;
+string load_error;
+
+/***** CONSTANTS *****/
+int MATCH_SCORE;
+int MATCH_SIZE;
+int GAP_SCORE;
+int GAP_SIZE;
+int OVERLAP_WINDOW;
+int UNIT_DIST;
+double E_VALUE;
+string PIVOT;
+int EXTENSION_DIST;
+int CUTOFF_SCORE;
+bool IN_SYNTENY;
+bool USE_BP;
+int NUM_THREADS;
+bool SPARSE_CHAIN;
+int OUT_OF_CORE;
+
+// one context in the globals at a time, for the whole process
+static pthread_mutex_t globals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* One pairwise comparison, chained independently of all the others */
+struct Pair_job
+{
+    Pair_stats st;
+    vector<Seg_feat> segs;
+    Match_store kept;  // anchors of segs when the matches are spilled
+};
+
+// what chain_job gets, the anchor buffers are reused by all jobs of a thread
+struct Chain_run
+{
+    Pair_job **order;
+    vector< vector<Score_t> > scratch;
+    vector<Match_store> loaded;  // the pair read back from spill_index
+    Mcscan *m;  // with keep_anchors
+};
+
+static void swap_data(Mcscan &m)
+/* exchange the data of m with the globals */
+{
+    gene_list.swap(m.gene_list);
+    mol_list.swap(m.mol_list);
+    match_list.swap(m.match_list);
+    seg_list.swap(m.seg_list);
+    mol_pairs.swap(m.mol_pairs);
+    pair_list.swap(m.pair_list);
+    pair_offsets.swap(m.pair_offsets);
+    chr_map.swap(m.chr_map);
+    spill_index.swap(m.spill_index);
+}
+
+/* Puts m into the globals for the lifetime of the object, holding
+ * globals_lock, so every API call runs alone */
+struct Serial_call
+{
+    Mcscan &m;
+
+    Serial_call(Mcscan &ctx) : m(ctx)
+    {
+        const Mcscan_params &p = m.params;
+
+        pthread_mutex_lock(&globals_lock);
+        swap_data(m);
+
+        MATCH_SCORE = p.match_score;
+        MATCH_SIZE = p.match_size;
+        GAP_SCORE = p.gap_score;
+        E_VALUE = p.e_value;
+        PIVOT = p.pivot;
+        NUM_THREADS = MAX(p.num_threads, 1);
+        IN_SYNTENY = p.in_synteny;
+        USE_BP = p.use_bp;
+        OUT_OF_CORE = MAX(p.out_of_core, 0);
+
+        // default unit values for the distance calculation
+        UNIT_DIST = p.unit_dist;
+        if (UNIT_DIST == 0) UNIT_DIST = USE_BP ? 10000 : 2;
+
+        OVERLAP_WINDOW = MATCH_SCORE*UNIT_DIST/10;
+        EXTENSION_DIST = MATCH_SCORE*UNIT_DIST/2;
+        CUTOFF_SCORE = MATCH_SCORE*MATCH_SIZE;
+        SPARSE_CHAIN = p.sparse_chain &&
+                       EXTENSION_DIST/UNIT_DIST + 1 <= SPARSE_MAX_BANDS;
+    }
+    ~Serial_call()
+    {
+        swap_data(m);
+        pthread_mutex_unlock(&globals_lock);
+    }
+};
+
+static void add_phase(Mcscan &m, const char *name, long start)
+/* a phase of m that began at clock_us() start ends now */
+{
+    m.stats.phase.push_back(name);
+    m.stats.phase_us.push_back(clock_us() - start);
+}
+
+void mcscan_defaults(Mcscan_params &p)
+/* Defaults of the mcscan command line */
+{
+    // match bonus, final score=MATCH_SCORE+GAPS*GAP_SCORE
+    p.match_score = 40;
+    // the number of genes required to call synteny, sometimes more
+    p.match_size = 5;
+    // gap extension penalty
+    p.gap_score = -2;
+    // alignment significance
+    p.e_value = 1e-5;
+    // align with a reference genome (occurs as first column in .blocks file)
+    p.pivot = "ALL";
+    p.unit_dist = 0;
+    p.num_threads = 1;
+    p.sparse_chain = false;
+    p.in_synteny = false;
+    p.use_bp = false;
+    p.out_of_core = 0;
+}
+
+void mcscan_print_params(Mcscan &m, FILE *fw)
+/* Parameter header of the output files */
+{
+    Serial_call call(m);
+    print_params(fw);
+}
+
+static void clear_data()
+/* empty the globals of a context */
+{
+    gene_list.clear(), mol_list.clear(), match_list.clear();
+    seg_list.clear(), mol_pairs.clear(), pair_list.clear();
+    pair_offsets.clear(), chr_map.clear(), spill_index.clear();
+}
+
+static bool load_input(Mcscan &m, const char *prefix_fn, bool with_mcl,
+                       const char *m8_fn, bool use_cache)
+/* the steps of mcscan_load, false with load_error set at the first one
+ * that fails */
+{
+    long start;
+    bool ok;
+
+    // every name made from the prefix, up to prefix_fn.cache.tmp, must fit
+    if (strlen(prefix_fn) + sizeof(".cache.tmp") > LABEL_LEN)
+        return input_error("Prefix %.32s... is longer than %d characters",
+                           prefix_fn,
+                           (int) (LABEL_LEN - sizeof(".cache.tmp")));
+
+    // the cache holds all the matches
+    if (OUT_OF_CORE) use_cache = false;
+    if (use_cache)
+    {
+        start = clock_us();
+        ok = load_cache(prefix_fn, with_mcl, m8_fn);
+        add_phase(m, "load_cache", start);
+        if (ok) return true;
+    }
+
+    start = clock_us();
+    if (!read_bed(prefix_fn)) return false;
+    add_phase(m, "read_bed", start);
+    if (with_mcl)
+    {
+        start = clock_us();
+        if (!read_mcl(prefix_fn)) return false;
+        add_phase(m, "read_mcl", start);
+    }
+    start = clock_us();
+    ok = m8_fn ? ingest_m8(m8_fn) : read_blast(prefix_fn);
+    if (!ok) return false;
+    add_phase(m, m8_fn ? "ingest_m8" : "read_blast", start);
+    if (use_cache)
+    {
+        start = clock_us();
+        if (!save_cache(prefix_fn, with_mcl, m8_fn)) return false;
+        add_phase(m, "save_cache", start);
+    }
+    return true;
+}
+
+bool mcscan_load(Mcscan &m, const char *prefix_fn, bool with_mcl,
+                 const char *m8_fn, bool use_cache)
+/* Read the input files of prefix_fn into m, false with the reason in
+ * m.error if they can't be read */
+{
+    Serial_call call(m);
+    clear_data();
+    m.anchors.clear(), m.anchor_window.clear();
+    m.error.clear();
+
+    if (load_input(m, prefix_fn, with_mcl, m8_fn, use_cache)) return true;
+    m.error = load_error;
+    clear_data();
+    return false;
+}
+
+static bool jobCmp(const Pair_job *a, const Pair_job *b)
+/* largest pair first, so the big ones do not end up last on one thread */
+{
+    return a->st.matches > b->st.matches;
+}
+
+static void keep_segs(Pair_job *job, const Match_store &ms)
+/* copy the anchors of job->segs out of ms, which goes to the next pair */
+{
+    Match_store &kept = job->kept;
+    vector<Seg_feat>::iterator it;
+    vector<int>::iterator ip;
+    tr(job->segs, it) tr(it->pids, ip)
+    {
+        kept.gene1.push_back(ms.gene1[*ip]);
+        kept.gene2.push_back(ms.gene2[*ip]);
+        kept.score.push_back(ms.score[*ip]);
+        *ip = kept.size() - 1;
+    }
+}
+
+static void chain_job(int i, int thread, void *arg)
+{
+    Chain_run *run = (Chain_run *) arg;
+    Pair_stats &st = run->order[i]->st;
+    vector<Score_t> &score = run->scratch[thread];
+    int p = st.mol_pair, first = pair_offsets[p], last = pair_offsets[p+1];
+    bool spilled = spill_index.fd >= 0;
+    const Match_store &ms = spilled ? run->loaded[thread] : match_list;
+    long start = clock_us();
+
+    if (spilled)
+    {
+        load_spilled(p, run->loaded[thread]);
+        first = 0, last = ms.size();
+    }
+    if (run->m == NULL) pair_anchors(ms, first, last, score);
+    else
+    {
+        /* dag_main reorders and compacts the anchors, so it gets a copy */
+        Mcscan &m = *run->m;
+        if (m.anchor_window[p] != OVERLAP_WINDOW)
+        {
+            pair_anchors(ms, first, last, m.anchors[p]);
+            m.anchor_window[p] = OVERLAP_WINDOW;
+        }
+        score = m.anchors[p];
+        vector<Score_t>::iterator it;
+        tr(score, it) it->score = MATCH_SCORE;
+    }
+    st.anchors = score.size();
+    st.filter_us = clock_us() - start;
+
+    start = clock_us();
+    dag_main(score, ms, pair_list[p], run->order[i]->segs, &st.dp);
+    if (spilled) keep_segs(run->order[i], ms);
+    st.segments = run->order[i]->segs.size();
+    st.chain_us = clock_us() - start;
+}
+
+static void append_kept(Pair_job &job)
+/* the anchors kept by keep_segs() join match_list, where segs point */
+{
+    int base = match_list.size();
+    vector<Seg_feat>::iterator it;
+    vector<int>::iterator ip;
+    Match_store &ms = match_list, &kept = job.kept;
+
+    if (kept.size() == 0) return;
+    ms.gene1.insert(ms.gene1.end(), all(kept.gene1));
+    ms.gene2.insert(ms.gene2.end(), all(kept.gene2));
+    ms.score.insert(ms.score.end(), all(kept.score));
+    tr(job.segs, it) tr(it->pids, ip) *ip += base;
+    Match_store().swap(kept);
+}
+
+void mcscan_chain(Mcscan &m)
+/* run dagchainer on all mol_pairs, segments are collected per pair and
+ * merged in pair_list order so the output does not depend on NUM_THREADS */
+{
+    Serial_call call(m);
+    vector<Pair_job> jobs;
+    vector<Pair_job *> order;
+    Pair_job job;
+    int i, n = pair_list.size(), max_n = 0;
+    long start = clock_us();
+
+    if (m.params.sparse_chain && !SPARSE_CHAIN)
+        progress("%d gap penalties are more than the %d trees of the "
+                 "sparse chaining engine, chaining the classic way",
+                 EXTENSION_DIST/UNIT_DIST + 1, SPARSE_MAX_BANDS);
+    seg_list.clear();
+    if (spill_index.fd >= 0) match_list.clear();
+    m.chained = Chain_count();
+    m.stats.pairs.clear();
+    job.st.anchors = job.st.segments = 0;
+    job.st.filter_us = job.st.chain_us = 0;
+    for (i=0; i<n; i++)
+    {
+        job.st.mol_pair = i;
+        job.st.matches = pair_offsets[i+1] - pair_offsets[i];
+        if (job.st.matches < MATCH_SIZE) continue;
+        jobs.push_back(job);
+        max_n = MAX(max_n, job.st.matches);
+    }
+    n = jobs.size();
+    if (n == 0)
+    {
+        add_phase(m, "chain", start);
+        return;
+    }
+
+    /* chained anchors are at most EXTENSION_DIST+1 apart on either axis */
+    init_permutation(max_n, MIN(EXTENSION_DIST+1, 1<<16));
+
+    for (i=0; i<n; i++) order.push_back(&jobs[i]);
+    stable_sort(order.begin(), order.end(), jobCmp);
+
+    Chain_run run;
+    run.order = &order[0];
+    run.scratch.resize(NUM_THREADS);
+    if (spill_index.fd >= 0) run.loaded.resize(NUM_THREADS);
+    run.m = NULL;
+    if (m.keep_anchors)
+    {
+        m.anchors.resize(pair_list.size());
+        m.anchor_window.resize(pair_list.size(), -1);
+        run.m = &m;
+    }
+    parallel_run(n, NUM_THREADS, chain_job, &run);
+
+    Chain_count &total = m.chained;
+    for (i=0; i<n; i++)
+    {
+        const Pair_stats &st = jobs[i].st;
+        append_kept(jobs[i]);
+        seg_list.insert(seg_list.end(), all(jobs[i].segs));
+        m.stats.pairs.push_back(st);
+        total.add(st.dp);
+    }
+    progress("%ld of %ld anchors chained incrementally (%.1f%%)",
+             total.done, total.full,
+             total.full ? 100.0*total.done/total.full : 100.0);
+    add_phase(m, "chain", start);
+}
+
+void mcscan_print_align(Mcscan &m, FILE *fw, bool mcl)
+/* The .aligns file, or three columns for mcl clustering */
+{
+    Serial_call call(m);
+    long start = clock_us();
+    if (mcl) print_align_mcl(fw);
+    else print_align(fw);
+    add_phase(m, "print_align", start);
+}
+
+void mcscan_pog(Mcscan &m, FILE *fw)
+/* Multiple alignment of the segments, the .blocks file goes to fw */
+{
+    Serial_call call(m);
+    long start = clock_us();
+    POG_main(fw, m.stats.pivots);
+    add_phase(m, "pog", start);
+}
+
+static void json_string(FILE *fw, const string &s)
+/* s quoted for JSON */
+{
+    const char *c;
+    fputc('"', fw);
+    for (c=s.c_str(); *c; c++)
+    {
+        if (*c == '"' || *c == '\\') fprintf(fw, "\\%c", *c);
+        else if ((unsigned char) *c < 0x20)
+            fprintf(fw, "\\u%04x", (unsigned char) *c);
+        else fputc(*c, fw);
+    }
+    fputc('"', fw);
+}
+
+void mcscan_write_stats(Mcscan &m, FILE *fw)
+/* m.stats as a JSON object, times in seconds */
+{
+    const Mcscan_params &p = m.params;
+    const Mcscan_stats &s = m.stats;
+    int i, n;
+
+    fprintf(fw, "{\n  \"params\": {\"match_score\": %d, \"match_size\": %d, "
+            "\"gap_score\": %d, \"e_value\": %g, \"unit_dist\": %d, "
+            "\"pivot\": ", p.match_score, p.match_size, p.gap_score,
+            p.e_value, p.unit_dist);
+    json_string(fw, p.pivot);
+    fprintf(fw, ", \"threads\": %d, \"chain\": \"%s\", \"use_bp\": %s, "
+            "\"in_synteny\": %s},\n", p.num_threads,
+            p.sparse_chain ? "sparse" : "classic",
+            p.use_bp ? "true" : "false", p.in_synteny ? "true" : "false");
+    fprintf(fw, "  \"genes\": %d, \"matches\": %d, \"mol_pairs\": %d, "
+            "\"segments\": %d,\n", (int) m.gene_list.size(),
+            m.pair_offsets.empty() ? m.match_list.size() :
+            m.pair_offsets.back(), (int) m.pair_list.size(),
+            (int) m.seg_list.size());
+
+    fprintf(fw, "  \"phases\": [");
+    n = s.phase.size();
+    for (i=0; i<n; i++)
+        fprintf(fw, "%s\n    {\"name\": \"%s\", \"seconds\": %.6f}",
+                i ? "," : "", s.phase[i].c_str(), s.phase_us[i]/1e6);
+    fprintf(fw, "\n  ],\n");
+
+    fprintf(fw, "  \"pairs\": [");
+    n = s.pairs.size();
+    for (i=0; i<n; i++)
+    {
+        const Pair_stats &q = s.pairs[i];
+        fprintf(fw, "%s\n    {\"mol_pair\": ", i ? "," : "");
+        json_string(fw, m.pair_list[q.mol_pair]);
+        fprintf(fw, ", \"matches\": %d, \"anchors\": %d, \"passes\": %d, "
+                "\"anchors_chained\": %ld, \"dp_steps\": %ld, "
+                "\"tests\": %d, \"segments\": %d, \"filter_seconds\": %.6f, "
+                "\"chain_seconds\": %.6f, \"test_seconds\": %.6f}",
+                q.matches, q.anchors, q.dp.passes, q.dp.done, q.dp.steps,
+                q.dp.tests, q.segments, q.filter_us/1e6, q.chain_us/1e6,
+                q.dp.test_us/1e6);
+    }
+    fprintf(fw, "\n  ],\n");
+
+    fprintf(fw, "  \"pivots\": [");
+    n = s.pivots.size();
+    for (i=0; i<n; i++)
+    {
+        const Pivot_stats &v = s.pivots[i];
+        fprintf(fw, "%s\n    {\"pivot\": ", i ? "," : "");
+        json_string(fw, m.mol_list[v.mol]);
+        fprintf(fw, ", \"clusters\": %d, \"regions\": %d, \"fused\": %d, "
+                "\"dp_matches\": %ld, \"sweeps\": %ld, \"nodes\": %d, "
+                "\"arena_MB\": %.1f, \"rows\": %d, \"cols\": %d, "
+                "\"seconds\": %.6f}", v.clusters, v.regions, v.fused,
+                v.matches, v.sweeps, v.nodes, v.arena_bytes/1048576.,
+                v.rows, v.cols, v.us/1e6);
+    }
+    fprintf(fw, "\n  ]\n}\n");
+}
@@ -0,0 +1,122 @@
+/*
+ * Library interface of MCSCAN, built as libmcscan.a and libmcscan.so
+ *
+ * A Mcscan context holds the parameters, the input and the results of one
+ * analysis, so a program can keep several of them and read the segments
+ * in memory instead of parsing the .aligns file:
+ *
+ *     Mcscan m;
+ *     mcscan_defaults(m.params);
+ *     m.params.match_size = 6;
+ *     if (!mcscan_load(m, "data/at_at", true))
+ *         fprintf(stderr, "%s\n", m.error.c_str());
+ *     mcscan_chain(m);
+ *     for (i=0; i<(int) m.seg_list.size(); i++) ...
+ *
+ * This is a serialized facade, not a reentrant library: the engine works
+ * on the globals of basic.h, and every call takes one process-wide lock
+ * and moves its context in there and back with vector swaps, which copy
+ * nothing and keep the gene pointers valid. Calls from several threads
+ * thus run one at a time, each on params.num_threads threads, and the
+ * context is empty to other threads while its call runs. Moving that state
+ * into Mcscan, which would make the calls reentrant, is not done yet.
+ *
+ * Bad input does not end the process: mcscan_load returns false with the
+ * reason in m.error. errAbort is left for what the caller can't fix, such
+ * as running out of memory, a thread that can't be started, or losing the
+ * out_of_core spill file.
+ */
+
+#ifndef __LIBMCSCAN_H
+#define __LIBMCSCAN_H
+
+#include "basic.h"
+
+/* Options of a run, as on the mcscan command line */
+struct Mcscan_params
+{
+    int match_score;
+    int match_size;
+    int gap_score;
+    double e_value;
+    string pivot;
+    int unit_dist;  // 0 for the default, 2 genes or 10000 bp with use_bp
+    int num_threads;
+    bool sparse_chain;
+    bool in_synteny;
+    bool use_bp;
+    int out_of_core;  // MB of matches held while reading, 0 for all
+};
+
+/* Where the time of a context went. Every call adds its phases; the pair
+ * and pivot counters are those of the last mcscan_chain and mcscan_pog */
+struct Mcscan_stats
+{
+    vector<string> phase;
+    vector<long> phase_us;
+    vector<Pair_stats> pairs;  // chained pairs in pair_list order
+    vector<Pivot_stats> pivots;  // in View order
+};
+
+/* One analysis. The segments and chr_map point into gene_list, so a
+ * context is not to be copied once loaded */
+struct Mcscan
+{
+    Mcscan_params params;
+
+    // input, see basic.h for the layout
+    vector<Gene_feat> gene_list;
+    vector<string> mol_list;
+    Match_store match_list;
+    map<string, int> mol_pairs;
+    vector<string> pair_list;
+    vector<int> pair_offsets;
+    vector<geneSet> chr_map;
+    Spill_index spill_index;
+
+    // result of mcscan_chain, the anchors of segment i are the matches
+    // seg_list[i].pids[j] (with out_of_core, match_list only has those)
+    vector<Seg_feat> seg_list;
+    Chain_count chained;
+    Mcscan_stats stats;
+    // why the last mcscan_load failed
+    string error;
+
+    // with keep_anchors, mcscan_chain keeps the filtered anchors of every
+    // mol_pair and only filters again the pairs whose OVERLAP_WINDOW
+    // (match_score*unit_dist/10) differs from the one they were built for
+    bool keep_anchors;
+    vector< vector<Score_t> > anchors;
+    vector<int> anchor_window;
+
+    Mcscan() : keep_anchors(false) {}
+};
+
+void mcscan_defaults(Mcscan_params &p);
+/* Defaults of the mcscan command line */
+
+void mcscan_print_params(Mcscan &m, FILE *fw);
+/* Parameter header of the output files */
+
+bool mcscan_load(Mcscan &m, const char *prefix_fn, bool with_mcl,
+                 const char *m8_fn=NULL, bool use_cache=false);
+/* Read prefix_fn.bed, prefix_fn.mcl with with_mcl, and prefix_fn.blast
+ * or the BLAST -m8 output m8_fn, through prefix_fn.cache with use_cache
+ * (not with out_of_core, which ignores it). A missing or malformed file,
+ * or a cache that can't be written, leaves m empty and returns false with
+ * the reason in m.error */
+
+void mcscan_chain(Mcscan &m);
+/* Pairwise chaining of all the chromosome pairs into m.seg_list */
+
+void mcscan_print_align(Mcscan &m, FILE *fw, bool mcl=false);
+/* The .aligns file, or three columns for mcl clustering with mcl */
+
+void mcscan_pog(Mcscan &m, FILE *fw);
+/* Multiple alignment of the segments onto each pivot, the .blocks file
+ * goes to fw (open_memstream keeps it in memory) */
+
+void mcscan_write_stats(Mcscan &m, FILE *fw);
+/* m.stats as a JSON object, times in seconds */
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * Text input helpers for the readers in read_data.cc
+ * The input files are memory mapped (or inflated in the background when
+ * gzipped) and tokenized in place, the tokens are looked up (e.g. gene
+ * names) before anything is copied out of them
+ */
+
+#include "line_reader.h"
+#include <stdint.h>
+#include <cfloat>
+
+// size of the inflated chunks, and how many may wait in the queue
+#define CHUNK_SIZE (1 << 22)
+#define QUEUE_LEN 4
+
+static void *inflate_worker(void *arg)
+/* background thread, inflates the .gz file into the chunk queue */
+{
+    Line_reader *r = (Line_reader *) arg;
+    Text_chunk c;
+    int n;
+
+    for (;;)
+    {
+        c.data = new char[CHUNK_SIZE];
+        n = gzread(r->gzf, c.data, CHUNK_SIZE);
+        if (n <= 0)
+        {
+            delete [] c.data;
+            // a truncated file ends with Z_BUF_ERROR rather than n < 0
+            int errnum;
+            const char *msg = gzerror(r->gzf, &errnum);
+            if (n < 0 || errnum == Z_BUF_ERROR)
+            {
+                pthread_mutex_lock(&r->lock);
+                r->error = msg;
+                pthread_mutex_unlock(&r->lock);
+            }
+            break;
+        }
+        c.len = n;
+
+        pthread_mutex_lock(&r->lock);
+        while ((int) r->chunks.size() >= QUEUE_LEN && !r->stop)
+            pthread_cond_wait(&r->not_full, &r->lock);
+        if (r->stop)
+        {
+            pthread_mutex_unlock(&r->lock);
+            delete [] c.data;
+            break;
+        }
+        r->chunks.push(c);
+        pthread_cond_signal(&r->not_empty);
+        pthread_mutex_unlock(&r->lock);
+    }
+
+    pthread_mutex_lock(&r->lock);
+    r->eof = true;
+    pthread_cond_signal(&r->not_empty);
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+bool Line_reader::open(const char *fileName)
+/* Open a file, false with load_error set if it can't be read */
+{
+    struct stat st;
+    int fd, err;
+
+    fn = fileName;
+    line_no = 0;
+    data = NULL;
+    size = len = pos = 0;
+    carry.clear();
+    carry_out = bad = false;
+    gz = false;
+
+    if ((fd = ::open(fileName, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+    {
+        input_error("Can't open %s to read: %s", fileName, strerror(errno));
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    if (fn.size() > 3 && fn.compare(fn.size()-3, 3, ".gz") == 0)
+    {
+        if ((gzf = gzdopen(fd, "rb")) == NULL)
+        {
+            input_error("Can't open %s to read: %s", fileName,
+                        strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        gz = true;
+        gzbuffer(gzf, 1 << 17);
+        eof = stop = false;
+        error.clear();
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&not_empty, NULL);
+        pthread_cond_init(&not_full, NULL);
+        if ((err = pthread_create(&tid, NULL, inflate_worker, this)) != 0)
+            errAbort("Can't create thread: %s", strerror(err));
+        return true;
+    }
+
+    if (st.st_size > 0)
+    {
+        data = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == (char *) MAP_FAILED)
+        {
+            input_error("Can't map %s: %s", fileName, strerror(errno));
+            data = NULL;
+            ::close(fd);
+            return false;
+        }
+        size = len = st.st_size;
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    return true;
+}
+
+bool Line_reader::next_chunk()
+/* swap in the next inflated chunk, false at the end of the file */
+{
+    Text_chunk c;
+
+    pthread_mutex_lock(&lock);
+    while (chunks.empty() && !eof)
+        pthread_cond_wait(&not_empty, &lock);
+    if (chunks.empty())
+    {
+        pthread_mutex_unlock(&lock);
+        if (!error.empty())
+            bad = !input_error("Can't read %s: %s", fn.c_str(),
+                               error.c_str());
+        return false;
+    }
+    c = chunks.front();
+    chunks.pop();
+    pthread_cond_signal(&not_full);
+    pthread_mutex_unlock(&lock);
+
+    delete [] data;
+    data = c.data;
+    len = c.len, pos = 0;
+    size += len;
+    return true;
+}
+
+bool Line_reader::next(const char *&begin, const char *&end)
+/* Range of the next line without the line break (\n or \r\n),
+ * false at the end of the file */
+{
+    const char *nl;
+
+    if (carry_out) carry.clear(), carry_out = false;
+    for (;;)
+    {
+        if (pos < len)
+        {
+            nl = (const char *) memchr(data+pos, '\n', len-pos);
+            if (nl)
+            {
+                if (carry.empty())
+                {
+                    begin = data+pos;
+                    end = nl;
+                }
+                else
+                {
+                    carry.append(data+pos, nl-(data+pos));
+                    begin = carry.data();
+                    end = begin + carry.size();
+                    carry_out = true;
+                }
+                pos = nl-data+1;
+                break;
+            }
+            carry.append(data+pos, data+len);
+            pos = len;
+        }
+        if (!gz || !next_chunk())
+        {
+            // last line without a line break, unless the text was cut
+            if (bad || carry.empty()) return false;
+            begin = carry.data();
+            end = begin + carry.size();
+            carry_out = true;
+            break;
+        }
+    }
+
+    if (end > begin && end[-1] == '\r') end--;
+    line_no++;
+    return true;
+}
+
+void Line_reader::close()
+{
+    if (gz)
+    {
+        pthread_mutex_lock(&lock);
+        stop = true;
+        pthread_cond_signal(&not_full);
+        pthread_mutex_unlock(&lock);
+        pthread_join(tid, NULL);
+
+        while (!chunks.empty())
+        {
+            delete [] chunks.front().data;
+            chunks.pop();
+        }
+        delete [] data;
+        gzclose(gzf);
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&not_empty);
+        pthread_cond_destroy(&not_full);
+    }
+    else if (data) munmap(data, len);
+    data = NULL;
+    len = pos = 0;
+    carry.clear();
+}
+
+void input_name(char *fn, const char *prefix_fn, const char *ext)
+/* prefix_fn.ext, or prefix_fn.ext.gz if only the compressed file exists */
+{
+    name_file(fn, "%s.%s", prefix_fn, ext);
+    if (access(fn, F_OK) == 0) return;
+    name_file(fn, "%s.%s.gz", prefix_fn, ext);
+    if (access(fn, F_OK) == 0) return;
+    name_file(fn, "%s.%s", prefix_fn, ext);
+}
+
+bool next_token(const char *&p, const char *end,
+                const char *&tok, int &len)
+/* Split off the next blank separated token of [p, end) */
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    if (p == end) return false;
+    tok = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    len = p-tok;
+    return true;
+}
+
+bool parse_int(const char *s, int len, int *v)
+/* Parse a decimal integer, false if malformed */
+{
+    const char *p = s, *end = s+len;
+    long x = 0;
+    bool neg = false;
+
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    if (p == end) return false;
+    for (; p < end; p++)
+    {
+        if (*p < '0' || *p > '9' || x > INT_MAX) return false;
+        x = x*10 + (*p-'0');
+    }
+    if (x > INT_MAX) return false;
+    *v = neg ? -x : x;
+    return true;
+}
+
+static const double pow10_exact[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// powers of ten beyond pow10_exact as 64-bit mantissa long doubles
+#define POW10_MIN -340
+#define POW10_MAX 310
+
+/* 10^e for POW10_MIN <= e <= POW10_MAX, read by strtold so that each is
+ * within half an ulp (2^-64 relative) of the exact value */
+struct Pow10_long
+{
+    long double p[POW10_MAX-POW10_MIN+1];
+    Pow10_long()
+    {
+        char s[16];
+        int e;
+        for (e=POW10_MIN; e<=POW10_MAX; e++)
+        {
+            sprintf(s, "1e%d", e);
+            p[e-POW10_MIN] = strtold(s, NULL);
+        }
+    }
+};
+static const Pow10_long pow10_long;
+
+static bool scale_long(uint64_t m, int exp10, double *v)
+/* m*10^exp10 rounded to double, false when that cannot be told apart
+ * from a tie. The long double product is off the exact value by at most
+ * two units in its last place (the error of the power and of the
+ * multiplication), so it rounds to the same double unless its 11 bits
+ * below the double mantissa are within that of the midpoint 0x400 */
+{
+#if LDBL_MANT_DIG == 64
+    long double r;
+    int ex;
+    uint64_t u;
+
+    if (exp10 < POW10_MIN || exp10 > POW10_MAX) return false;
+    r = (long double) m * pow10_long.p[exp10-POW10_MIN];
+    // doubles below DBL_MIN have fewer mantissa bits
+    if (!(r >= DBL_MIN && r <= DBL_MAX)) return false;
+    u = (uint64_t) ldexpl(frexpl(r, &ex), 64);
+    ex = (int) (u & 0x7ff) - 0x400;
+    if (ex >= -3 && ex <= 3) return false;
+    *v = (double) r;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool parse_double(const char *s, int len, double *v)
+/* Parse a floating point number such as 2e-28, false if malformed.
+ * When the mantissa fits in 53 bits and the power of ten is exact the
+ * result is one correctly rounded multiplication (Clinger's fast path);
+ * other exponents, such as those of most BLAST e-values, are scaled in
+ * long double and checked against rounding ties (scale_long). Anything
+ * else goes through strtod, so the value is always the same */
+{
+    const char *p = s, *end = s+len;
+    uint64_t m = 0;
+    int digits = 0, exp10 = 0, e = 0, esign = 1;
+    bool neg = false, ok = true;
+
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+    {
+        if (m < 100000000000000000ul) m = m*10 + (*p-'0');
+        else ok = false, exp10++;
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+        {
+            if (m < 100000000000000000ul) m = m*10 + (*p-'0'), exp10--;
+            else ok = false;
+        }
+    }
+    if (digits > 0 && p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) esign = *p++ == '-' ? -1 : 1;
+        if (p == end) digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            if (e < 10000) e = e*10 + (*p-'0');
+    }
+    exp10 += esign*e;
+
+    if (ok && digits > 0 && p == end &&
+            m <= (1ul << 53) && exp10 >= -22 && exp10 <= 22)
+    {
+        *v = exp10 < 0 ? m / pow10_exact[-exp10] : m * pow10_exact[exp10];
+        if (neg) *v = -*v;
+        return true;
+    }
+    if (ok && digits > 0 && p == end && scale_long(m, exp10, v))
+    {
+        if (neg) *v = -*v;
+        return true;
+    }
+
+    /* the slow but exact way, also takes inf, nan and hex */
+    char buf[LABEL_LEN], *stop;
+    if (len >= LABEL_LEN) return false;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    *v = strtod(buf, &stop);
+    return len > 0 && stop == buf+len;
+}
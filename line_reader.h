@@ -0,0 +1,73 @@
+#ifndef __LINE_READER_H
+#define __LINE_READER_H
+
+#include "basic.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* Chunk of decompressed text passed from the inflate thread */
+struct Text_chunk
+{
+    char *data;
+    size_t len;
+};
+
+/* Reads a text file line by line without copying. A plain file is mapped
+ * into memory and every line is handed out as a [begin, end) range into it.
+ * A .gz file is inflated by a background thread into chunks that come
+ * through a bounded queue, so decompression overlaps with the parsing, only
+ * lines that straddle two chunks are copied. */
+struct Line_reader
+{
+    string fn;
+    int line_no;
+    // bytes of text read so far
+    size_t size;
+    // a read error ended the file early, see load_error
+    bool bad;
+
+    bool open(const char *fileName);
+    /* Open a file, false with load_error set if it can't be read */
+
+    bool next(const char *&begin, const char *&end);
+    /* Range of the next line without the line break (\n or \r\n),
+     * false at the end of the file or once bad is set */
+
+    void close();
+
+    // mapped file or the current chunk
+    char *data;
+    size_t len, pos;
+    // line that straddles two chunks
+    string carry;
+    bool carry_out;
+
+    // gzip input
+    bool gz, eof, stop;
+    gzFile gzf;
+    string error;
+    queue<Text_chunk> chunks;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+
+    bool next_chunk();
+};
+
+void input_name(char *fn, const char *prefix_fn, const char *ext);
+/* prefix_fn.ext, or prefix_fn.ext.gz if only the compressed file exists */
+
+bool next_token(const char *&p, const char *end,
+                const char *&tok, int &len);
+/* Split off the next blank separated token of [p, end) */
+
+bool parse_int(const char *s, int len, int *v);
+/* Parse a decimal integer, false if malformed */
+
+bool parse_double(const char *s, int len, double *v);
+/* Parse a floating point number such as 2e-28, false if malformed */
+
+#endif
@@ -3,12 +3,16 @@
  * Main entry point for the executable mcscan
 */
 
-#include "mcscan.h"
+#include "libmcscan.h"
 
 static bool IS_PAIRWISE;
 static bool BUILD_MCL;
+static bool USE_CACHE;
+static char *M8_FILE;
+static char *SWEEP_FILE;
+static char *STATS_FILE;
 static char prefix_fn[LABEL_LEN];
-
+static Mcscan_params opt;
 
 const char *argp_program_version = "MCSCAN 0.8";
 const char *argp_program_bug_address = "<bao@uga.edu>";
@@ -27,6 +31,10 @@ const unsigned int nargs = 1;
 static char args_doc[] = "prefix_fn";
 static char *args[nargs];
 
+/* Keys for options without a short name */
+enum { OPT_CACHE = 256, OPT_INGEST_M8, OPT_CHAIN, OPT_SWEEP, OPT_STATS,
+       OPT_OUT_OF_CORE };
+
 /* The options we understand. */
 static struct argp_option options[] =
 {
@@ -39,9 +47,33 @@ static struct argp_option options[] =
      "PIVOT is the reference genome, make it two letter prefix in "\
      "your .bed file, everything else will be aligned to the reference" },
     {"unit_dist", 'u', "UNIT_DIST", 0, "average intergenic distance" },
+    {"threads", 't', "NUM_THREADS", 0,
+     "number of threads used in pairwise chaining and multiple "\
+     "alignment" },
+    {"chain", OPT_CHAIN, "ENGINE", 0,
+     "pairwise chaining engine, classic (default) or sparse for "\
+     "dense anchors; sparse keeps a tree per gap penalty and falls "\
+     "back to classic above 32 of them (MATCH_SCORE over 63)" },
     {0, 'A', 0, 0, "use base pair dist instead of gene ranks" },
     {0, 'a', 0, 0, "only builds the pairwise blocks (.aligns file)" },
     {0, 'b', 0, 0, "limit within genome synteny (e.g. Vv-Vv) mapping" },
+    {"cache", OPT_CACHE, 0, 0,
+     "keep the parsed input in prefix_fn.cache and reuse it while the "\
+     "input files are unchanged" },
+    {"ingest-m8", OPT_INGEST_M8, "M8_FILE", 0,
+     "read the raw BLAST -m8 output instead of prefix_fn.blast, "\
+     "keeping the best e-value of every gene pair" },
+    {"sweep", OPT_SWEEP, "SWEEP_FILE", 0,
+     "chain once for every MATCH_SCORE GAP_SCORE MATCH_SIZE UNIT_DIST "\
+     "line of SWEEP_FILE, the input is read once, each setting writes "\
+     "prefix_fn.kK_gG_sS_uU.aligns and prefix_fn.sweep sums them up" },
+    {"stats", OPT_STATS, "STATS_FILE", 0,
+     "write the time of every phase and the counters of every "\
+     "chromosome pair and pivot to STATS_FILE as JSON" },
+    {"out-of-core", OPT_OUT_OF_CORE, "MB", 0,
+     "hold at most about MB megabytes of BLAST matches in memory while "\
+     "reading, the rest wait in a temporary file in TMPDIR and are read "\
+     "back one chromosome pair at a time" },
     { 0 }
 };
 
@@ -54,31 +86,56 @@ parse_opt (int key, char *arg, struct argp_state *state)
     switch (key)
     {
     case 'k':
-        MATCH_SCORE = atoi(arg);
+        opt.match_score = atoi(arg);
         break;
     case 'g':
-        GAP_SCORE = atoi(arg);
+        opt.gap_score = atoi(arg);
         break;
     case 's':
-        MATCH_SIZE = atoi(arg);
+        opt.match_size = atoi(arg);
         break;
     case 'e':
-        E_VALUE = atof(arg);
+        opt.e_value = atof(arg);
         break;
     case 'p':
-        PIVOT = string(arg);
+        opt.pivot = string(arg);
         break;
     case 'u':
-        UNIT_DIST = atoi(arg);
+        opt.unit_dist = atoi(arg);
+        break;
+    case 't':
+        opt.num_threads = atoi(arg);
         break;
     case 'a':
         IS_PAIRWISE = true;
         break;
     case 'b':
-        IN_SYNTENY = true;
+        opt.in_synteny = true;
         break;
     case 'A':
-        USE_BP = true;
+        opt.use_bp = true;
+        break;
+    case OPT_CACHE:
+        USE_CACHE = true;
+        break;
+    case OPT_INGEST_M8:
+        M8_FILE = arg;
+        break;
+    case OPT_SWEEP:
+        SWEEP_FILE = arg;
+        break;
+    case OPT_STATS:
+        STATS_FILE = arg;
+        break;
+    case OPT_OUT_OF_CORE:
+        opt.out_of_core = atoi(arg);
+        if (opt.out_of_core <= 0)
+            argp_error(state, "--out-of-core needs a positive number of MB");
+        break;
+    case OPT_CHAIN:
+        if (sameString(arg, "sparse")) opt.sparse_chain = true;
+        else if (sameString(arg, "classic")) opt.sparse_chain = false;
+        else argp_error(state, "unknown chaining engine %s", arg);
         break;
 
     case ARGP_KEY_ARG:
@@ -109,46 +166,180 @@ static struct argp argp = { options, parse_opt, args_doc, doc };
 static int read_opt (int argc, char **argv)
 {
     /* Default values. */
-    // match bonus, final score=MATCH_SCORE+GAPS*GAP_SCORE
-    MATCH_SCORE = 40;
-    // the number of genes required to call synteny, sometimes more
-    MATCH_SIZE = 5;
-    // gap extension penalty
-    GAP_SCORE = -2;
-    // alignment significance
-    E_VALUE = 1e-5;
-    // align with a reference genome (occurs as first column in .blocks file)
-    PIVOT = "ALL";
-    UNIT_DIST = 0;
+    mcscan_defaults(opt);
 
     IS_PAIRWISE = false;
     BUILD_MCL = false;
-    IN_SYNTENY = false;
-    USE_BP = false;
+    USE_CACHE = false;
+    M8_FILE = NULL;
+    SWEEP_FILE = NULL;
+    STATS_FILE = NULL;
 
     /* Parse our arguments; every option seen by parse_opt will
       be reflected in arguments. */
     argp_parse (&argp, argc, argv, 0, 0, 0);
-    strcpy(prefix_fn, args[0]);
+    name_file(prefix_fn, "%s", args[0]);
+    if (USE_CACHE && opt.out_of_core)
+        errAbort("--cache keeps all the matches, it does not go with "
+                 "--out-of-core");
 
+    return 0;
+}
 
-    // default unit values for the distance calculation
-    if (USE_BP) 
+static long peak_rss(bool reset)
+/* Peak resident set size in kB since the last reset, where the kernel
+ * lets it be cleared (Linux), otherwise since the start */
+{
+    char line[256];
+    long kb = -1;
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f != NULL)
+    {
+        while (fgets(line, sizeof line, f))
+            if (sscanf(line, "VmHWM: %ld", &kb) == 1) break;
+        fclose(f);
+    }
+    if (kb < 0)
     {
-        if (UNIT_DIST==0) UNIT_DIST = 10000;
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        kb = ru.ru_maxrss;
     }
-    else
+    if (reset && (f = fopen("/proc/self/clear_refs", "w")) != NULL)
     {
-        if (UNIT_DIST==0) UNIT_DIST = 2;
+        fputs("5", f);
+        fclose(f);
     }
+    return kb;
+}
 
-    OVERLAP_WINDOW = MATCH_SCORE*UNIT_DIST/10;
-    EXTENSION_DIST = MATCH_SCORE*UNIT_DIST/2;
-    CUTOFF_SCORE = MATCH_SCORE*MATCH_SIZE;
+/* One setting of a parameter sweep and what it gave */
+struct Sweep_point
+{
+    Mcscan_params p;
+    int blocks;
+    long anchors;
+    int genes;  // genes spanned by a block on either side
+};
 
-    return 0;
+static int overlap_window(const Mcscan_params &p)
+/* OVERLAP_WINDOW of a setting, the anchors depend on nothing else */
+{
+    int unit = p.unit_dist ? p.unit_dist : p.use_bp ? 10000 : 2;
+    return p.match_score*unit/10;
+}
+
+static bool windowCmp(const Sweep_point *a, const Sweep_point *b)
+{
+    return overlap_window(a->p) < overlap_window(b->p);
 }
 
+static void read_sweep(const char *fn, vector<Sweep_point> &pts)
+/* one setting per line: MATCH_SCORE GAP_SCORE MATCH_SIZE UNIT_DIST, the
+ * other parameters come from the command line, # starts a comment */
+{
+    char line[LABEL_LEN], *c;
+    int n, line_no = 0;
+    Sweep_point s;
+    FILE *fp = mustOpen(fn, "r");
+
+    s.p = opt;
+    s.blocks = 0, s.anchors = 0, s.genes = 0;
+    while (fgets(line, sizeof line, fp))
+    {
+        line_no++;
+        if ((c = strchr(line, '#')) != NULL) *c = '\0';
+        n = sscanf(line, "%d %d %d %d", &s.p.match_score, &s.p.gap_score,
+                   &s.p.match_size, &s.p.unit_dist);
+        if (n == EOF) continue;
+        if (n != 4) errAbort("%s:%d: expected MATCH_SCORE GAP_SCORE "
+                                 "MATCH_SIZE UNIT_DIST", fn, line_no);
+        pts.push_back(s);
+    }
+    fclose(fp);
+    if (pts.empty()) errAbort("%s: no settings to sweep", fn);
+}
+
+static void sum_up(const Mcscan &m, Sweep_point &s)
+/* blocks, anchors and genes covered by the segments of m */
+{
+    vector<char> covered(m.gene_list.size(), 0);
+    const Gene_feat *g0 = &m.gene_list[0];
+    vector<Seg_feat>::const_iterator it;
+    int a, b;
+
+    s.blocks = m.seg_list.size();
+    s.anchors = 0;
+    tr(m.seg_list, it)
+    {
+        s.anchors += it->pids.size();
+        a = it->s1 - g0, b = it->t1 - g0;
+        fill(covered.begin() + MIN(a, b), covered.begin() + MAX(a, b) + 1, 1);
+        a = it->s2 - g0, b = it->t2 - g0;
+        fill(covered.begin() + MIN(a, b), covered.begin() + MAX(a, b) + 1, 1);
+    }
+    s.genes = count(covered.begin(), covered.end(), 1);
+}
+
+static void run_sweep(Mcscan &m)
+/* chain every setting of SWEEP_FILE on the input loaded in m, settings
+ * with the same OVERLAP_WINDOW share the filtered anchors */
+{
+    char fn[LABEL_LEN];
+    vector<Sweep_point> pts;
+    vector<Sweep_point *> order;
+    FILE *fw;
+    int i, n;
+
+    read_sweep(SWEEP_FILE, pts);
+    n = pts.size();
+    for (i=0; i<n; i++) order.push_back(&pts[i]);
+    stable_sort(order.begin(), order.end(), windowCmp);
+
+    m.keep_anchors = true;
+    for (i=0; i<n; i++)
+    {
+        Sweep_point &s = *order[i];
+        m.params = s.p;
+        mcscan_chain(m);
+        sum_up(m, s);
+
+        name_file(fn, "%s.k%d_g%d_s%d_u%d.aligns", prefix_fn,
+                  s.p.match_score, s.p.gap_score, s.p.match_size,
+                  s.p.unit_dist);
+        fw = mustOpen(fn, "w");
+        mcscan_print_align(m, fw, BUILD_MCL);
+        fclose(fw);
+        uglyTime("Setting %d of %d, %d alignments written to %s",
+                 i+1, n, s.blocks, fn);
+    }
+
+    name_file(fn, "%s.sweep", prefix_fn);
+    fw = mustOpen(fn, "w");
+    fprintf(fw, "#match_score\tgap_score\tmatch_size\tunit_dist\t"
+            "blocks\tanchors\tgenes\tcoverage\n");
+    for (i=0; i<n; i++)
+    {
+        Sweep_point &s = pts[i];
+        fprintf(fw, "%d\t%d\t%d\t%d\t%d\t%ld\t%d\t%.4f\n",
+                s.p.match_score, s.p.gap_score, s.p.match_size,
+                s.p.unit_dist, s.blocks, s.anchors, s.genes,
+                m.gene_list.empty() ? 0. : (double) s.genes/m.gene_list.size());
+    }
+    fclose(fw);
+    progress("Sweep of %d settings summed up in %s", n, fn);
+}
+
+static int finish(Mcscan &m)
+/* write the stats if asked for, the exit code of main */
+{
+    if (STATS_FILE == NULL) return 0;
+    FILE *fw = mustOpen(STATS_FILE, "w");
+    mcscan_write_stats(m, fw);
+    fclose(fw);
+    progress("Stats written to %s", STATS_FILE);
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -157,42 +348,48 @@ int main(int argc, char *argv[])
 
     char align_fn[LABEL_LEN], block_fn[LABEL_LEN];
     FILE *fw;
+    Mcscan m;
 
     read_opt(argc, argv);
-    print_params(stdout);
+    m.params = opt;
+    mcscan_print_params(m, stdout);
 
-    read_bed(prefix_fn);
-    if (!IS_PAIRWISE) read_mcl(prefix_fn);
-    read_blast(prefix_fn);
+    if (!mcscan_load(m, prefix_fn, !IS_PAIRWISE, M8_FILE, USE_CACHE))
+        errAbort("%s", m.error.c_str());
+    uglyTime("Input loaded");
 
-    sprintf(align_fn, "%s.aligns", prefix_fn);
+    if (SWEEP_FILE)
+    {
+        run_sweep(m);
+        return finish(m);
+    }
+
+    name_file(align_fn, "%s.aligns", prefix_fn);
     fw = mustOpen(align_fn, "w");
 
-    progress("%d pairwise comparisons", (int) mol_pairs.size());
+    progress("%d pairwise comparisons", (int) m.mol_pairs.size());
 
-    map<string, int>::const_iterator ip;
-    for (ip=mol_pairs.begin(); ip!=mol_pairs.end(); ip++)
-    {
-        if (ip->second >= MATCH_SIZE) feed_dag(string(ip->first));
-    }
+    mcscan_chain(m);
 
-    progress("%d alignments generated", (int) seg_list.size());
-    if (BUILD_MCL) print_align_mcl(fw);
-    else print_align(fw);
+    progress("%d alignments generated", (int) m.seg_list.size());
+    mcscan_print_align(m, fw, BUILD_MCL);
 
     fclose(fw);
     uglyTime("Pairwise synteny written to %s", align_fn);
 
-    if (IS_PAIRWISE) return 0;
+    if (IS_PAIRWISE) return finish(m);
 
-    sprintf(block_fn, "%s.blocks", prefix_fn);
+    name_file(block_fn, "%s.blocks", prefix_fn);
     fw = mustOpen(block_fn, "w");
 
-    POG_main(fw);
+    // the pivots run concurrently, so only the whole phase has a peak
+    peak_rss(true);
+    mcscan_pog(m, fw);
+    progress("Peak RSS of the multiple alignment %.1f MB",
+             peak_rss(false)/1024.);
 
     fclose(fw);
     uglyTime("Multiple synteny written to %s", block_fn);
 
-    return 0;
+    return finish(m);
 }
-
@@ -4,40 +4,40 @@
 #include "basic.h"
 
 // read_data
-extern void read_blast(const char *prefix_fn, bool gff_flag=true);
-extern void read_mcl(const char *prefix_fn);
-extern void read_bed(const char *prefix_fn);
+extern bool read_blast(const char *prefix_fn, bool gff_flag=true);
+extern bool read_mcl(const char *prefix_fn);
+extern bool read_bed(const char *prefix_fn);
 extern void feed_pog();
-extern void feed_dag (const string &mol_pair);
+extern void pair_anchors(const Match_store &ms, int first, int last,
+                         vector<Score_t> &score);
 extern void read_cfg();
 
+// dagchainer
+extern void dag_main(vector<Score_t> &score, const Match_store &ms,
+                     const string &mol_pair,
+                     vector<Seg_feat> &segs, Chain_count *cnt);
+
+// cache
+extern bool load_cache(const char *prefix_fn, bool with_mcl,
+                       const char *m8_fn);
+extern bool save_cache(const char *prefix_fn, bool with_mcl,
+                       const char *m8_fn);
+
+// ingest
+extern bool ingest_m8(const char *m8_fn, bool gff_flag=true);
+
+// spill
+extern void load_spilled(int mol_pair, Match_store &ms);
+
+// permutation
+extern void init_permutation(int max_n, int max_gap);
+
 // pog
-extern void POG_main(FILE *fw);
+extern void POG_main(FILE *fw, vector<Pivot_stats> &stats);
 
 // out_utils
 extern void print_params(FILE *fw);
 extern void print_align(FILE* fw);
 extern void print_align_mcl(FILE *fw);
 
-/***** Instantiate all data *****/
-map<string, Gene_feat> gene_map;
-vector<Blast_record> match_list;
-vector<Seg_feat> seg_list;
-map<string, int> mol_pairs;
-map<string, geneSet > chr_map;
-
-/***** CONSTANTS *****/
-int MATCH_SCORE;
-int MATCH_SIZE;
-int GAP_SCORE;
-int GAP_SIZE;
-int OVERLAP_WINDOW;
-int UNIT_DIST;
-double E_VALUE;
-string PIVOT;
-int EXTENSION_DIST;
-int CUTOFF_SCORE;
-bool IN_SYNTENY;
-bool USE_BP;
-
 #endif
@@ -21,110 +21,277 @@ void print_params(FILE *fw)
     fprintf( fw, "# PIVOT: %s\n", PIVOT.c_str() );
     fprintf( fw, "##########################################\n\n");
 }
-void print_align(FILE* fw)
-/* print alignment */
+// Out_buf writes once it holds this many bytes
+#define OUT_BUF_SIZE (1<<22)
+// print_align formats this many anchors per chunk on each thread
+#define ALIGN_CHUNK 65536
+
+/* Powers of ten of the normal doubles, read by strtod so that they are
+ * the nearest doubles to the exact values */
+struct Pow10_table
 {
-    int i, j, pid;
-    int nseg = seg_list.size(), nanchor;
-    Seg_feat *s;
+    double p[616];
+    Pow10_table()
+    {
+        char s[16];
+        int e;
+        for (e=-307; e<=308; e++)
+        {
+            sprintf(s, "1e%d", e);
+            p[e+307] = strtod(s, NULL);
+        }
+    }
+    double operator () (int e) const { return p[e+307]; }
+};
+static const Pow10_table pow_ten;
 
-    print_params(fw);
+void Out_buf::put_int(int x, int width)
+{
+    char d[16], *p = d + sizeof(d);
+    unsigned int u = x < 0 ? 0u - (unsigned int) x : x;
+    int n;
 
-    for (i=0; i<nseg; i++)
+    do *--p = '0' + u % 10; while (u /= 10);
+    if (x < 0) *--p = '-';
+    n = d + sizeof(d) - p;
+    if (n < width) text.append(width - n, ' ');
+    text.append(p, n);
+}
+
+void Out_buf::put_g1(double x, int width)
+/* one significant digit, fixed from 1e-4 to 9, exponent otherwise; ties
+ * go to snprintf, which rounds the exact binary value */
+{
+    char s[32];
+    int n = 0, e, d;
+    double m;
+
+    if (x > 1e-300 && x < 1e300)
+    {
+        e = (int) floor(log10(x));
+        if (x < pow_ten(e)) e--;
+        else if (x >= pow_ten(e+1)) e++;
+        m = x / pow_ten(e);
+        d = (int) (m + 0.5);
+        if (fabs(m - (int) m - 0.5) < 1e-9) n = -1;
+        if (d == 10) d = 1, e++;
+    }
+    else n = -1;
+
+    if (n < 0) n = snprintf(s, sizeof(s), "%.1g", x);
+    else if (e >= -4 && e <= 0)
     {
-        s = &seg_list[i];
-        nanchor = s->pids.size();
-        fprintf(fw, "## Alignment %d: score=%.1f e_value=%.2g N=%d %s %s\n",
-                i, s->score, s->e_value, nanchor, s->mol_pair.c_str(),
-                s->sameStrand?"plus":"minus");
-        for (j=0; j<nanchor; j++)
+        if (e < 0)
         {
-            pid = s->pids[j];
-            fprintf(fw, "%3d-%3d:\t%s\t%s\t%7.1g\n",
-                    i, j, match_list[pid].gene1.c_str(),
-                    match_list[pid].gene2.c_str(), match_list[pid].score);
+            s[n++] = '0', s[n++] = '.';
+            for (; e<-1; e++) s[n++] = '0';
         }
+        s[n++] = '0' + d;
     }
+    else
+    {
+        s[n++] = '0' + d;
+        s[n++] = 'e';
+        s[n++] = e < 0 ? '-' : '+';
+        if (e < 0) e = -e;
+        if (e >= 100) s[n++] = '0' + e/100;
+        s[n++] = '0' + e/10%10;
+        s[n++] = '0' + e%10;
+    }
+    if (n < width) text.append(width - n, ' ');
+    text.append(s, n);
 }
 
-void print_align_mcl(FILE* fw)
-/* sometimes we wish to print to a simple three-column file for mcl clustering */
+void Out_buf::format(const char *fmt, ...)
 {
-    int i, j, pid;
-    int nseg = seg_list.size(), nanchor;
-    Seg_feat *s;
-    for (i=0; i<nseg; i++)
+    char s[LABEL_LEN];
+    va_list args;
+    int n;
+    size_t at;
+
+    va_start(args, fmt);
+    n = vsnprintf(s, sizeof(s), fmt, args);
+    va_end(args);
+    if (n < (int) sizeof(s))
     {
-        s = &seg_list[i];
-        nanchor = s->pids.size();
-        for (j=0; j<nanchor; j++)
+        text.append(s, n);
+        return;
+    }
+    at = text.size();
+    text.resize(at + n + 1);
+    va_start(args, fmt);
+    vsnprintf(&text[at], n + 1, fmt, args);
+    va_end(args);
+    text.resize(at + n);
+}
+
+void Out_buf::end_line()
+{
+    text += '\n';
+    if (fw && text.size() >= OUT_BUF_SIZE) flush();
+}
+
+void Out_buf::flush()
+{
+    if (fw == NULL || text.empty()) return;
+    fwrite(text.data(), 1, text.size(), fw);
+    text.clear();
+}
+
+static void print_segment(Out_buf &out, int i, bool mcl)
+/* alignment i of seg_list, or its anchors in three columns with mcl */
+{
+    const Seg_feat *s = &seg_list[i];
+    int j, pid, nanchor = s->pids.size();
+
+    if (!mcl)
+        out.format("## Alignment %d: score=%.1f e_value=%.2g N=%d %s %s\n",
+                   i, s->score, s->e_value, nanchor, s->mol_pair.c_str(),
+                   s->sameStrand?"plus":"minus");
+    for (j=0; j<nanchor; j++)
+    {
+        pid = s->pids[j];
+        if (!mcl)
         {
-            pid = s->pids[j];
-            fprintf(fw, "%s\t%s\t%.1g\n",
-                    match_list[pid].gene1.c_str(),
-                    match_list[pid].gene2.c_str(), match_list[pid].score);
+            out.put_int(i, 3);
+            out.put('-');
+            out.put_int(j, 3);
+            out.put(":\t");
         }
+        out.put(gene_list[match_list.gene1[pid]].name);
+        out.put('\t');
+        out.put(gene_list[match_list.gene2[pid]].name);
+        out.put('\t');
+        out.put_g1(match_list.score[pid], mcl ? 0 : 7);
+        out.end_line();
+    }
+}
+
+// what align_job gets, chunk k holds segments first[k]..first[k+1]-1
+struct Align_run
+{
+    vector<int> first;
+    vector<Out_buf> out;
+    int base;  // chunk of out[0]
+    bool mcl;
+};
+
+static void align_job(int i, int thread, void *arg)
+{
+    Align_run *run = (Align_run *) arg;
+    int k = run->base + i, s;
+    run->out[i].text.clear();
+    for (s=run->first[k]; s<run->first[k+1]; s++)
+        print_segment(run->out[i], s, run->mcl);
+}
+
+static void print_segments(FILE *fw, bool mcl)
+/* chunks of about ALIGN_CHUNK anchors are formatted on NUM_THREADS
+ * threads, a few rounds at a time, and written out in order */
+{
+    int i, k, n, nseg = seg_list.size(), anchors = 0;
+
+    if (NUM_THREADS <= 1)
+    {
+        Out_buf out(fw);
+        for (i=0; i<nseg; i++) print_segment(out, i, mcl);
+        return;
+    }
+
+    Align_run run;
+    run.mcl = mcl;
+    for (i=0; i<nseg; i++)
+    {
+        if (i == 0 || anchors >= ALIGN_CHUNK)
+            run.first.push_back(i), anchors = 0;
+        anchors += seg_list[i].pids.size();
+    }
+    run.first.push_back(nseg);
+    n = run.first.size() - 1;
+    run.out.resize(MIN(4*NUM_THREADS, n));
+
+    for (run.base=0; run.base<n; run.base+=run.out.size())
+    {
+        k = MIN((int) run.out.size(), n - run.base);
+        parallel_run(k, NUM_THREADS, align_job, &run);
+        for (i=0; i<k; i++)
+            fwrite(run.out[i].text.data(), 1, run.out[i].text.size(), fw);
     }
 }
 
-void print_geneSet(FILE *fw, const geneSet &g)
-/* helper function to print out geneSet(*/
+void print_align(FILE* fw)
+/* print alignment */
+{
+    print_params(fw);
+    print_segments(fw, false);
+}
+
+void print_align_mcl(FILE* fw)
+/* sometimes we wish to print to a simple three-column file for mcl clustering */
+{
+    print_segments(fw, true);
+}
+
+void print_genes(Out_buf &out, const Gene_range &g)
+/* helper function to print out the genes of a POG node */
 {
-    geneSet::const_iterator i=g.begin();
-    if (g.empty()) fprintf(fw, ".");
-    for (; i!=g.end(); i++)
+    Gene_feat *const *i=g.first;
+    if (g.empty()) out.put('.');
+    for (; i!=g.last; i++)
     {
-        if (i!=g.begin()) fprintf(fw, ";");
-        fprintf(fw, "%s", (*i)->name.c_str());
+        if (i!=g.first) out.put(';');
+        out.put((*i)->name);
     }
 }
 
-void print_POG_memory(FILE *fw, const POG_order &ref, int block)
+void print_POG_memory(Out_buf &out, const POG_order &ref, int block)
 /* print verbose info about ref for debugging */
 {
     POG_order::const_iterator it;
-    set<POG_node *>::const_iterator p;
+    POG_node *const *p;
     int j = 0;
     for (it=ref.begin(); it!=ref.end(); it++)
     {
-        fprintf(fw, "%3d-%4d:\t", block, j++);
-        print_geneSet(fw, (*it)->master_genes);
-        fprintf(fw, "\t");
-        if ((*it)->fusion.empty()) fprintf(fw, ".");
+        out.format("%3d-%4d:\t", block, j++);
+        print_genes(out, (*it)->master_genes);
+        out.put('\t');
+        if ((*it)->fusion.empty()) out.put('.');
         for (p=(*it)->fusion.begin(); p!=(*it)->fusion.end(); p++)
         {
-            print_geneSet(fw, (*p)->genes);
-            fprintf(fw, "|");
+            print_genes(out, (*p)->genes);
+            out.put('|');
         }
-        fprintf(fw, "\t[%p]\t", (void*)*it);
+        out.format("\t[%p]\t", (void*)*it);
         for (p=(*it)->next.begin(); p!=(*it)->next.end(); p++)
-            fprintf(fw, "`%p", (void*)*p);
-        fprintf(fw, "\n");
+            out.format("`%p", (void*)*p);
+        out.end_line();
     }
 }
 
-void print_POG_block(FILE *fw, const POG_order &ref, int block, int cols)
+void print_POG_block(Out_buf &out, const POG_order &ref, int block, int cols)
 /* multiple blocks output */
 {
     POG_order::const_iterator it;
-    set<POG_node *>::const_iterator p;
+    POG_node *const *p;
     vector<POG_node *> v(cols);
     int j = 0, k;
     for (it=ref.begin(); it!=ref.end(); it++)
     {
-        fprintf(fw, "%3d-%4d:\t", block, j++);
-        print_geneSet(fw, (*it)->master_genes);
+        out.put_int(block, 3);
+        out.put('-');
+        out.put_int(j++, 4);
+        out.put(":\t");
+        print_genes(out, (*it)->master_genes);
         /* by now the columns for the syntenic region has been assigned */
         for (k=0; k<cols; k++) v[k] = NULL;
         for (p=(*it)->fusion.begin(); p!=(*it)->fusion.end(); p++)
             v[(*p)->r->col] = *p;
         for (k=0; k<cols; k++)
         {
-            fprintf(fw, "\t");
-            if (v[k] == NULL) fprintf(fw, ".");
-            else print_geneSet(fw, v[k]->genes);
+            out.put('\t');
+            if (v[k] == NULL) out.put('.');
+            else print_genes(out, v[k]->genes);
         }
-        fprintf(fw, "\n");
+        out.end_line();
     }
 }
-
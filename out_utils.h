@@ -3,14 +3,35 @@
 
 #include "basic.h"
 
+/* Text formatted in memory and written to fw in large blocks, or kept
+ * whole when fw is NULL. The numbers come out as printf would print
+ * them, which it is only asked to do for the rare ambiguous cases */
+struct Out_buf
+{
+    FILE *fw;
+    string text;
+
+    Out_buf(FILE *f=NULL) : fw(f) {}
+    ~Out_buf() { flush(); }
+
+    void put(char c) { text += c; }
+    void put(const char *s) { text += s; }
+    void put(const string &s) { text += s; }
+    void put_int(int x, int width=0);  // %<width>d
+    void put_g1(double x, int width=0);  // %<width>.1g
+    void format(const char *fmt, ...);  // printf
+    void end_line();  // '\n', written out once the buffer is full
+    void flush();
+};
+
 /* pairwise blocks */
 void print_align(FILE *fw);
 void print_align_mcl(FILE *fw);
 
 /* multiple blocks */
-void print_geneSet(FILE *fw, const geneSet &g);
+void print_genes(Out_buf &out, const Gene_range &g);
 void print_params(FILE *fw);
-void print_POG_memory(FILE *fw, const POG_order &ref, int block);
-void print_POG_block(FILE *fw, const POG_order &ref, int block, int col);
+void print_POG_memory(Out_buf &out, const POG_order &ref, int block);
+void print_POG_block(Out_buf &out, const POG_order &ref, int block, int col);
 
 #endif
@@ -33,7 +33,10 @@ static double fact(int x)
     return ans;
 }
 
-static double ln_fact(int x)
+// tables filled by init_permutation, see ln_fact() and ln_spacing()
+static vector<double> ln_fact_tab, ln_tab;
+
+static double stirling(int x)
 /* ln(x!) using Stirling's formula, see Knuth I: 111 */
 {
     double dx = x, invx, invx2, invx3, invx5, invx7, sum;
@@ -56,6 +59,42 @@ static double ln_fact(int x)
     }
 }
 
+void init_permutation(int max_n, int max_gap)
+/* tabulate ln(x!) for x <= max_n and ln(x) for 1 <= x <= max_gap, the
+ * entries are the very values stirling() and log() return, so the e-values
+ * do not move; call before the pairs are chained in parallel */
+{
+    int i;
+    ln_fact_tab.resize(max_n+1);
+    for (i=0; i<=max_n; i++) ln_fact_tab[i] = stirling(i);
+    ln_tab.resize(max_gap+1);
+    if (max_gap >= 0) ln_tab[0] = -HUGE_VAL;
+    for (i=1; i<=max_gap; i++) ln_tab[i] = log((double) i);
+}
+
+static inline double ln_fact(int x)
+{
+    return x < (int) ln_fact_tab.size() ? ln_fact_tab[x] : stirling(x);
+}
+
+static inline double ln_int(int x)
+{
+    return x < (int) ln_tab.size() ? ln_tab[x] : log((double) x);
+}
+
+double ln_spacing(const vector<Score_t> &score, const vector<int> &ans)
+/* sum of ln(l1)+ln(l2) over successive anchors of a chain, l1 and l2 being
+ * their distances on either axis; summed in chain order like before */
+{
+    int i, m = ans.size();
+    double summation = 0;
+
+    for (i=1; i<m; i++)
+        summation += ln_int(abs(score[ans[i]].x - score[ans[i-1]].x)) +
+                     ln_int(abs(score[ans[i]].y - score[ans[i-1]].y));
+    return summation;
+}
+
 double ln_perm(int n, int r)
 /* natural log of permutation number */
 {
@@ -3,6 +3,8 @@
 
 #include "basic.h"
 
+void init_permutation(int max_n, int max_gap);
 double ln_perm(int n, int r);
+double ln_spacing(const vector<Score_t> &score, const vector<int> &ans);
 
 #endif
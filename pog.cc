@@ -13,13 +13,55 @@
 
 #include "pog.h"
 
-static POG_order ref, ref_slave, master, slave;
-static vector<POG_node *> memory_pool;
-static DPVec v, track_v;
-static vector<Syn_region> Q;
-static vector<End_point> endpoints;
-static Syn_region *syn;
-static int cols;
+// tandem clusters of all chromosomes, built once: cluster k holds
+// tandem_genes[cluster_start[k] .. cluster_start[k+1]-1] and the clusters
+// of chromosome mol are chr_cluster[mol] .. chr_cluster[mol+1]-1
+static vector<Gene_feat *> tandem_genes;
+static vector<int> cluster_start, chr_cluster;
+// cluster of each gene by index into gene_list, -1 when not in the mcl
+static vector<int> gene_cluster;
+
+/* Everything a pivot is aligned with, each thread keeps one and reuses it
+ * for the pivots it takes, pivots share only the clusters above */
+struct POG_context
+{
+    POG_order ref;
+    POG_path master, slave;
+    // ref node made from each cluster of the pivot chromosome
+    vector<POG_node *> ref_index;
+    // nodes of the current pivot and their edge lists, released at once
+    Arena arena;
+    int pog_nodes;
+    DPVec v, track_v;
+    vector<int> best_x, best_y;
+    vector<Syn_region> Q;
+    vector<End_point> endpoints;
+    Syn_region *syn;
+    int cols;
+    FILE *log;  // progress messages of the pivot
+    Pivot_stats st;  // counters of the pivot
+};
+
+/* .blocks section and progress messages of one pivot */
+struct Pivot_out
+{
+    string text;
+    char *log;
+    size_t log_len;
+    bool done;
+};
+
+// what pivot_job gets, finished pivots are written out in View order
+struct POG_run
+{
+    vector<int> pivots;  // chromosome of each View
+    vector<POG_context> ctx;
+    vector<Pivot_out> out;
+    vector<Pivot_stats> *stats;
+    int written;
+    FILE *fw;
+    pthread_mutex_t lock;
+};
 
 /* Comparator for sorting */
 bool synCmp (const Syn_region &a, const Syn_region &b)
@@ -34,134 +76,199 @@ static bool check_self_genome(const string &s)
     return s.substr(0, 2) == s.substr(pos+1, 2);
 }
 
-static void init_POG(POG_order &g, const geneSet &s)
-/* convert geneSet to POG_order by merging consecutive tandems*/
+static POG_node *new_POG_node(POG_context &c, int node)
+/* a fresh node, not yet placed in any POG_order */
 {
-    g.clear();
-    geneSet::const_iterator i = s.begin();
-    POG_node *t = new POG_node;
-    memory_pool.push_back(t);
-    t->node = (*i)->node;
-    t->master_genes.insert(*i);
-    g.push_back(t);
-
-    for (i++; i!=s.end(); i++)
+    POG_node *t = new (c.arena.alloc(sizeof(POG_node))) POG_node;
+    c.pog_nodes++;
+    t->master_genes.first = t->master_genes.last = NULL;
+    t->genes = t->master_genes;
+    t->node = node;
+    t->rank = -1;
+    return t;
+}
+
+static void init_clusters()
+/* merge consecutive tandems of every chromosome in chr_map once, the
+ * pivots and the syntenic regions are all made from these clusters */
+{
+    int mol, nmol = chr_map.size();
+    geneSet::const_iterator i;
+
+    tandem_genes.clear(), cluster_start.clear(), chr_cluster.clear();
+    gene_cluster.assign(gene_list.size(), -1);
+    for (mol=0; mol<nmol; mol++)
     {
-        if ((*i)->node != t->node)
+        chr_cluster.push_back(cluster_start.size());
+        for (i=chr_map[mol].begin(); i!=chr_map[mol].end(); i++)
         {
-            t = new POG_node;
-            memory_pool.push_back(t);
-            t->node = (*i)->node;
-            g.push_back(t);
+            if (i==chr_map[mol].begin() || (*i)->node!=tandem_genes.back()->node)
+                cluster_start.push_back(tandem_genes.size());
+            gene_cluster[*i - &gene_list[0]] = cluster_start.size()-1;
+            tandem_genes.push_back(*i);
         }
-        t->master_genes.insert(*i);
+    }
+    chr_cluster.push_back(cluster_start.size());
+    cluster_start.push_back(tandem_genes.size());
+}
+
+static Gene_range cluster_genes(int k)
+/* genes of cluster k */
+{
+    Gene_range r;
+    r.first = &tandem_genes[0] + cluster_start[k];
+    r.last = &tandem_genes[0] + cluster_start[k+1];
+    return r;
+}
+
+static void init_POG(POG_context &c, int mol)
+/* convert the clusters of chromosome mol to c.ref, ref_index learns the
+ * node of each cluster */
+{
+    int k, first = chr_cluster[mol], last = chr_cluster[mol+1];
+    POG_order &g = c.ref;
+    POG_node *t;
+
+    g.clear();
+    c.ref_index.resize(last - first);
+    for (k=first; k<last; k++)
+    {
+        t = new_POG_node(c, tandem_genes[cluster_start[k]]->node);
+        t->master_genes = cluster_genes(k);
+        t->at = g.insert(g.end(), t);
+        c.ref_index[k - first] = t;
     }
 }
 
-static void link_POG(POG_order &g)
+template <class Order>
+static void link_POG(POG_context &c, Order &g)
 /* populate the directed edge in the graph */
 {
-    POG_order::const_iterator i = g.begin();
+    typename Order::const_iterator i = g.begin();
     POG_node *t = *i;
     for (i++; i!=g.end(); i++)
     {
-        t->next.insert(*i);
+        t->next.push_back(*i, c.arena);
         t = *i;
     }
 }
 
-static void init_synteny(POG_order &g, POG_order &t,
-                         Gene_feat *a, Gene_feat *b)
-/* collects all the genes in range [*a, *b] */
+static bool cluster_range(Gene_feat *a, Gene_feat *b, int &first, int &last)
+/* clusters [first, last) spanning genes *a to *b, last is -1 if *b is not
+ * found after *a, the range then runs to the end of the chromosome */
 {
-    POG_node *p;
-    POG_order::const_iterator it=t.begin();
-    g.clear();
-    for (; it!=t.end(); it++)
-    {
-        p = *it;
-        if (p->node == a->node &&
-                p->master_genes.find(a) != p->master_genes.end()) break;
-    }
-    for (; it!=t.end(); it++)
-    {
-        p = *it;
-        g.push_back(p);
-        if (p->node == b->node &&
-                p->master_genes.find(b) != p->master_genes.end()) break;
-    }
+    first = gene_cluster[a - &gene_list[0]];
+    if (first < 0) return false;
+    last = gene_cluster[b - &gene_list[0]];
+    last = last < first ? -1 : last+1;
+    return true;
 }
-static void init_master(Gene_feat *a, Gene_feat *b)
+
+static void init_master(POG_context &c, Gene_feat *a, Gene_feat *b)
 /* master version - collects all the genes in range [*a, *b] */
 {
-    POG_order &g = master;
-    printf(" search between %s - %s\n", a->name.c_str(), b->name.c_str());
+    POG_path &g = c.master;
+    POG_order::const_iterator it;
+    int first, last;
+    fprintf(c.log, " search between %s - %s\n", a->name.c_str(), b->name.c_str());
 
-    init_synteny(g, ref, a, b);
+    /* walk ref from the node of *a, fused slave nodes are included */
+    g.clear();
+    if (cluster_range(a, b, first, last))
+    {
+        int base = chr_cluster[a->mol];
+        POG_node *q = last < 0 ? NULL : c.ref_index[last-1 - base];
+        for (it=c.ref_index[first - base]->at; it!=c.ref.end(); it++)
+        {
+            g.push_back(*it);
+            if (*it == q) break;
+        }
+    }
 
-    printf(" master contains %d elements.\n", (int)master.size());
+    fprintf(c.log, " master contains %d elements.\n", (int)g.size());
 }
 
-static void init_slave(Gene_feat *a, Gene_feat *b, bool sameStrand)
-/* slave version - collects all the genes in range [*a, *b] */
+static void init_slave(POG_context &c, Gene_feat *a, Gene_feat *b,
+                       bool sameStrand)
+/* slave version - nodes for the clusters in range [*a, *b] only */
 {
-    POG_order &g = slave;
-    init_POG(ref_slave, chr_map[a->mol]);
-    printf(" search between %s - %s\n", a->name.c_str(), b->name.c_str());
-
-    init_synteny(g, ref_slave, a, b);
-    if (!sameStrand) reverse(g.begin(), g.end());
-    link_POG(slave);
+    POG_path &g = c.slave;
+    POG_node *t;
+    int first, last, k;
+    fprintf(c.log, " search between %s - %s\n", a->name.c_str(), b->name.c_str());
 
     /* slave regions do not require master_genes */
-    POG_order::iterator j = g.begin();
-    for (; j!=g.end(); j++)
+    g.clear();
+    if (cluster_range(a, b, first, last))
     {
-        (*j)->genes = (*j)->master_genes;
-        (*j)->master_genes.clear();
-        (*j)->fusion.insert(*j);
-        (*j)->r = syn;
+        if (last < 0) last = chr_cluster[a->mol+1];
+        for (k=first; k<last; k++)
+        {
+            t = new_POG_node(c, tandem_genes[cluster_start[k]]->node);
+            t->genes = cluster_genes(k);
+            t->fusion.push_back(t, c.arena);
+            t->r = c.syn;
+            g.push_back(t);
+        }
     }
+    if (!sameStrand) reverse(g.begin(), g.end());
+    if (!g.empty()) link_POG(c, g);
 
-    printf(" slave contains %d elements.\n", (int)slave.size());
+    fprintf(c.log, " slave contains %d elements.\n", (int)g.size());
 }
 
-static void refresh_POG(POG_order &g)
-/* helper function to use with DFS */
+template <class Order>
+static void rank_POG(Order &g, bool on)
+/* number the nodes of g in order, or clear the numbers with !on */
 {
-    POG_order::iterator i = g.begin();
-    for (; i!=g.end(); i++) (*i)->visited = false;
+    typename Order::iterator i;
+    int k = 0;
+    for (i=g.begin(); i!=g.end(); i++) (*i)->rank = on ? k++ : -1;
 }
 
-static void DFS(POG_node *src, POG_node *target,
-                int score, int &max_score)
-/* performs a depth-first-search to get distance between src and target */
+static void spread_POG(const vector<POG_node *> &g, int src,
+                       vector<int> &best)
+/* best path score from g[src] to every node of g, starting at MATCH_SCORE
+ * and adding GAP_SCORE per edge. The order of g is topological, fused
+ * paths are spliced in right after their first node, so one pass does;
+ * like the depth-first search this replaces, a path that falls to
+ * -MATCH_SCORE is given up and unreachable nodes stay at -MATCH_SCORE.
+ * Edges leaving g are not followed, one going back in g aborts */
 {
-    /* prune when it is impossible to get more better score  */
-    if (score <= max_score) return;
-    else if (src == target)
-    {
-        max_score = score;
-        return;
-    }
-    set<POG_node *>::const_iterator p;
-    for (p=src->next.begin(); p!=src->next.end(); p++)
+    POG_node *const *p;
+    int i, n = g.size(), s;
+
+    best.assign(n, -MATCH_SCORE);
+    best[src] = MATCH_SCORE;
+    for (i=src; i<n; i++)
     {
-        if ((*p)->visited) continue;
-        (*p)->visited = true;
-        DFS(*p, target, score+GAP_SCORE, max_score);
+        if (best[i] == -MATCH_SCORE) continue;
+        s = best[i] + GAP_SCORE;
+        if (s <= -MATCH_SCORE) continue;
+        for (p=g[i]->next.begin(); p!=g[i]->next.end(); p++)
+        {
+            // ranks are -1 off g, a rank up to i would be a cycle
+            if ((*p)->rank < 0) continue;
+            if ((*p)->rank <= i)
+                errAbort("spread_POG: edge from node %d back to node %d, "
+                         "the partial order graph is not in topological "
+                         "order", i, (*p)->rank);
+            if (s > best[(*p)->rank]) best[(*p)->rank] = s;
+        }
     }
 }
 
-static void fuse_POG_node(POG_node *t, POG_node *g)
+static void fuse_POG_node(POG_context &c, POG_node *t, POG_node *g)
 /* dump the genes in fused POG node for gene retrieval */
 {
-    t->fusion.insert(g);
+    t->fusion.insert(g, c.arena);
 }
 
-static void fuse_POG()
+static void fuse_POG(POG_context &c)
 /* backtracking through the best path and fuse aligned POGs */
 {
+    DPVec &v = c.v, &track_v = c.track_v;
+    POG_path &slave = c.slave;
     int n=v.size(), max_score = 0, max_i = -1, i;
     for (i=0; i<n; i++)
     {
@@ -172,9 +279,9 @@ static void fuse_POG()
         }
     }
     //for (i=0; i<n; i++) printf("%d ", v[i].score); puts("");
-    printf(" best pog path score %d\n", max_score);
+    fprintf(c.log, " best pog path score %d\n", max_score);
     if (max_score < CUTOFF_SCORE) return;
-    syn->score = max_score;
+    c.syn->score = max_score;
 
     track_v.clear();
     DP *a = &v[max_i], *b;
@@ -185,54 +292,55 @@ static void fuse_POG()
     }
     reverse(track_v.begin(), track_v.end());
 
+    /* master nodes know their place in ref, slave nodes their rank */
     n = track_v.size();
-    POG_order::iterator is, it, ix, iy;
+    POG_order::iterator is;
+    int ix, iy, k;
     for (i=0; i<n-1; i++)
     {
         a = &track_v[i];
         b = &track_v[i+1];
-        is = find(ref.begin(), ref.end(), a->s);
+        is = a->s->at;
         is++;
-        it = find(ref.begin(), ref.end(), b->s);
-        ix = find(slave.begin(), slave.end(), a->t);
-        ix++;
-        iy = find(slave.begin(), slave.end(), b->t);
+        ix = a->t->rank + 1;
+        iy = b->t->rank;
 
         /* insert the interleaved slave nodes before master nodes */
-        ref.insert(is, ix, iy);
+        for (k=ix; k<iy; k++) slave[k]->at = c.ref.insert(is, slave[k]);
 
         /* fix links and merge nodes */
-        fuse_POG_node(a->s, a->t);
-        fuse_POG_node(b->s, b->t);
+        fuse_POG_node(c, a->s, a->t);
+        fuse_POG_node(c, b->s, b->t);
 
         /* make sure the interleaved slave nodes are non-empty */
         if (ix != iy)
         {
-            a->s->next.insert(*ix);
-            iy--;
-            (*iy)->next.clear();
-            (*iy)->next.insert(b->s);
+            a->s->next.insert(slave[ix], c.arena);
+            slave[iy-1]->next.clear();
+            slave[iy-1]->next.push_back(b->s, c.arena);
         }
         else
-            a->s->next.insert(b->s);
+            a->s->next.insert(b->s, c.arena);
     }
 
     /* for .blocks layout */
     End_point ep;
-    ep.s = syn;
+    ep.s = c.syn;
     ep.a = track_v.begin()->s;
     ep.start = true;
-    endpoints.push_back(ep);
-    ep.s = syn;
+    c.endpoints.push_back(ep);
+    ep.s = c.syn;
     ep.a = track_v.rbegin()->s;
     ep.start = false;
-    endpoints.push_back(ep);
+    c.endpoints.push_back(ep);
 }
 
-static void align_POG()
+static void align_POG(POG_context &c)
 /* core algorithm, one dimensional dynamic programming */
 {
-    POG_order::const_iterator i=master.begin(), j=slave.begin();
+    POG_path &master = c.master, &slave = c.slave;
+    DPVec &v = c.v;
+    POG_path::const_iterator i=master.begin(), j=slave.begin();
     //for (; i!=master.end(); i++) printf("%d ", (*i)->node); puts("");
     //for (; j!=slave.end(); j++) printf("%d ", (*j)->node); puts("");
 
@@ -250,22 +358,32 @@ static void align_POG()
             }
         }
     }
-    /* distances between matches are computed and plugged in formula*/
+    /* distances between matches are computed and plugged in formula,
+     * one pass over each graph gives those from a to all later matches */
     int n=v.size(), aa, bb, del_x, del_y, del;
     DP *a, *b;
+    rank_POG(master, true);
+    rank_POG(slave, true);
+    c.st.matches += n;
     for (aa=0; aa<n; aa++)
     {
         a = &v[aa];
+        spread_POG(master, a->s->rank, c.best_x);
+        c.st.sweeps++;
+        c.best_y.clear();
         for (bb=aa+1; bb<n; bb++)
         {
             b = &v[bb];
             if (a->s == b->s || a->t == b->t ) continue;
-            refresh_POG(master), refresh_POG(slave);
 
-            del_x = del_y = -MATCH_SCORE;
-            DFS(a->s, b->s, MATCH_SCORE, del_x);
+            del_x = c.best_x[b->s->rank];
             if (del_x == -MATCH_SCORE) break;
-            DFS(a->t, b->t, MATCH_SCORE, del_y);
+            if (c.best_y.empty())
+            {
+                spread_POG(slave, a->t->rank, c.best_y);
+                c.st.sweeps++;
+            }
+            del_y = c.best_y[b->t->rank];
             if (del_y == -MATCH_SCORE) continue;
             del = a->score + MIN(del_x, del_y);
 
@@ -276,14 +394,17 @@ static void align_POG()
             }
         }
     }
-    fuse_POG();
+    fuse_POG(c);
+    rank_POG(master, false);
+    rank_POG(slave, false);
 
     v.clear();
 }
 
-static void cluster_POG(const string &mol)
+static void cluster_POG(POG_context &c, int mol)
 /* collect threaded alignments from dagchainer and re-align */
 {
+    vector<Syn_region> &Q = c.Q;
     bool match1, match2;
     int n = seg_list.size(), i;
 
@@ -312,42 +433,38 @@ static void cluster_POG(const string &mol)
 
     for (i=0; i<n; i++)
     {
-        syn = &Q[i];
-        s = syn->s;
+        c.syn = &Q[i];
+        s = c.syn->s;
         if (IN_SYNTENY && check_self_genome(s->mol_pair)) continue;
-        printf(" original dagchainer score %.1f\n", s->score);
-        if (syn->match1)
+        c.st.regions++;
+        fprintf(c.log, " original dagchainer score %.1f\n", s->score);
+        if (c.syn->match1)
         {
-            init_master(s->s1, s->t1);
-            init_slave(s->s2, s->t2, s->sameStrand);
-            align_POG();
+            init_master(c, s->s1, s->t1);
+            init_slave(c, s->s2, s->t2, s->sameStrand);
+            align_POG(c);
         }
         else
         {
-            init_master(s->s2, s->t2);
-            init_slave(s->s1, s->t1, s->sameStrand);
-            align_POG();
+            init_master(c, s->s2, s->t2);
+            init_slave(c, s->s1, s->t1, s->sameStrand);
+            align_POG(c);
         }
     }
 }
 
-static void layout_POG()
+static void layout_POG(POG_context &c)
 {
+    POG_order &ref = c.ref;
+    vector<End_point> &endpoints = c.endpoints;
     POG_order::const_iterator it;
     vector<End_point>::iterator ip;
-    int i = 0;
+    int &cols = c.cols;
 
+    rank_POG(ref, true);
     for (ip=endpoints.begin(); ip!=endpoints.end(); ip++)
-    {
-        for (i=0, it=ref.begin(); it!=ref.end(); it++, i++)
-        {
-            if (*it == ip->a)
-            {
-                ip->ref_index = i;
-                break;
-            }
-        }
-    }
+        ip->ref_index = ip->a->rank;
+    rank_POG(ref, false);
     sort(endpoints.begin(), endpoints.end());
 
     ip = endpoints.begin();
@@ -380,41 +497,115 @@ static void layout_POG()
     }
 }
 
-void POG_main(FILE *fw)
+static void align_pivot(POG_context &c, int mol, int view, Out_buf &out)
+/* re-align the syntenic regions of pivot mol and print its .blocks
+ * section to out */
 {
-    map<string, geneSet >::const_iterator it;
-    vector<POG_node *>::iterator iq;
-    int i=0;
+    const string &query = mol_list[mol];
+
+    init_POG(c, mol);
+    link_POG(c, c.ref);
+
+    c.st.mol = mol;
+    c.st.clusters = c.ref.size();
+    fprintf(c.log, "## pivot %s contains %d tandem clusters\n",
+            query.c_str(), (int)c.ref.size());
+    cluster_POG(c, mol);
+    out.format("## View %d: pivot %s\n", view, query.c_str());
+
+    //print_POG_memory(out, c.ref, view);
+    layout_POG(c);
+    print_POG_block(out, c.ref, view, c.cols);
+    c.st.fused = c.endpoints.size()/2;
+    c.st.nodes = c.pog_nodes;
+    c.st.rows = c.ref.size(), c.st.cols = c.cols;
+
+    out.end_line();
+
+    c.st.arena_bytes = c.arena.bytes;
+    fprintf(c.log, "## pivot %s used %d POG nodes, %ld allocations, "
+            "arena %.1f MB\n", query.c_str(), c.pog_nodes, c.arena.allocs,
+            c.arena.bytes/1048576.);
+
+    c.ref.clear(), c.master.clear(), c.slave.clear();
+    /* release the memory held by partial order graph */
+    c.arena.reset();
+    c.pog_nodes = 0;
+    c.Q.clear(), c.endpoints.clear();
+}
 
-    print_params(fw);
+static FILE *open_buffer(char **text, size_t *len)
+/* a FILE writing to memory */
+{
+    FILE *f = open_memstream(text, len);
+    if (f == NULL) errAbort("Can't buffer the pivot log: %s",
+                                strerror(errno));
+    return f;
+}
 
-    for (it=chr_map.begin(); it!=chr_map.end(); it++)
+static void pivot_job(int i, int thread, void *arg)
+{
+    POG_run *run = (POG_run *) arg;
+    POG_context &c = run->ctx[thread];
+    Pivot_out &o = run->out[i];
+
+    long start = clock_us();
+    Out_buf out;
+    c.log = open_buffer(&o.log, &o.log_len);
+    c.st = Pivot_stats();
+    align_pivot(c, run->pivots[i], i, out);
+    fclose(c.log);
+    o.text.swap(out.text);
+    c.st.us = clock_us() - start;
+    (*run->stats)[i] = c.st;
+
+    /* pass on every finished pivot whose predecessors are out */
+    pthread_mutex_lock(&run->lock);
+    o.done = true;
+    int n = run->out.size();
+    for (; run->written<n && run->out[run->written].done; run->written++)
     {
-        if (PIVOT!="ALL" && it->first.find(PIVOT)==string::npos) continue;
-        if ((int)it->second.size() < MATCH_SIZE) continue;
-
-        string query = it->first;
-        init_POG(ref, it->second);
-        link_POG(ref);
-
-        printf("## pivot %s contains %d tandem clusters\n",
-               query.c_str(), (int)ref.size());
-        cluster_POG(query);
-        fprintf(fw, "## View %d: pivot %s\n", i, query.c_str());
-
-        //print_POG_memory(fw, ref, i);
-        layout_POG();
-        print_POG_block(fw, ref, i, cols);
-
-        fprintf(fw, "\n");
-
-        ref.clear(), ref_slave.clear(), master.clear(), slave.clear();
-        /* release the memory held by partial order graph */
-        for (iq=memory_pool.begin(); iq!=memory_pool.end(); iq++)
-            delete *iq;
-        memory_pool.clear();
-        Q.clear(), endpoints.clear();
-        i++;
+        Pivot_out &w = run->out[run->written];
+        fwrite(w.log, 1, w.log_len, stdout);
+        fwrite(w.text.data(), 1, w.text.size(), run->fw);
+        free(w.log), string().swap(w.text);
     }
+    pthread_mutex_unlock(&run->lock);
 }
 
+void POG_main(FILE *fw, vector<Pivot_stats> &stats)
+/* pivots are aligned in parallel, each into its own buffer, and written
+ * out in View order, so the output does not depend on NUM_THREADS; stats
+ * gets the counters of every View */
+{
+    int mol, nmol=chr_map.size();
+    POG_run run;
+
+    print_params(fw);
+    init_clusters();
+
+    for (mol=0; mol<nmol; mol++)
+    {
+        const string &query = mol_list[mol];
+        if (PIVOT!="ALL" && query.find(PIVOT)==string::npos) continue;
+        if (chr_map[mol].empty() ||
+                (int)chr_map[mol].size() < MATCH_SIZE) continue;
+        run.pivots.push_back(mol);
+    }
+    int n = run.pivots.size(), nthreads = MIN(NUM_THREADS, n);
+    stats.assign(n, Pivot_stats());
+    if (n == 0) return;
+
+    Pivot_out o;
+    o.log = NULL, o.log_len = 0, o.done = false;
+    run.out.assign(n, o);
+    run.ctx.resize(nthreads);
+    run.stats = &stats;
+    run.written = 0;
+    run.fw = fw;
+    pthread_mutex_init(&run.lock, NULL);
+    parallel_run(n, nthreads, pivot_job, &run);
+    pthread_mutex_destroy(&run.lock);
+
+    progress("%d pivots aligned", n);
+}
@@ -2,13 +2,8 @@
 #define __POG_H
 
 #include "basic.h"
+#include "out_utils.h"
 
-void POG_main(FILE *fw);
-
-// out_utils
-extern void print_params(FILE *fw);
-extern void print_geneSet(FILE *fw, const geneSet &g);
-extern void print_POG_memory(FILE *fw, const POG_order &ref, int block);
-extern void print_POG_block(FILE *fw, const POG_order &ref, int block, int col);
+void POG_main(FILE *fw, vector<Pivot_stats> &stats);
 
 #endif
@@ -10,236 +10,400 @@
 
 #include "read_data.h"
 
-// incremental sorting y coord
-static bool cmp_y (const Score_t& t1, const Score_t& t2)
-{
-    return t1.y < t2.y ||
-           (t1.y == t2.y && t1.x < t2.x);
-}
-
 // incremental sorting e-value
 static bool cmp_ev (const Score_t& t1, const Score_t& t2)
 {
     return t1.score < t2.score;
 }
 
+// chromosome ids to mol_pair id, the pairs are named in index_pairs()
+static map<pair<int, int>, int> pair_ids;
+
+bool add_match(int id1, int id2, double score, bool gff_flag)
+/* append the hit between gene id1 and id2 (lexically ordered) to
+ * match_list, unless they are in different MCL groups */
+{
+    Gene_feat *gf1 = &gene_list[id1], *gf2 = &gene_list[id2];
+    map<pair<int, int>, int>::iterator ip;
+
+    // assert both has the same MCL node id
+    if (gff_flag && gf1->node != gf2->node) return false;
+
+    ip = pair_ids.find(make_pair(gf1->mol, gf2->mol));
+    if (ip == pair_ids.end())
+        ip = pair_ids.insert(make_pair(make_pair(gf1->mol, gf2->mol),
+                                       (int) pair_ids.size())).first;
+
+    match_list.gene1.push_back(id1);
+    match_list.gene2.push_back(id2);
+    match_list.score.push_back(score);
+    match_list.mol_pair.push_back(ip->second);
+    // 20 bytes a match, and as much again while spill_matches() runs
+    if (OUT_OF_CORE && match_list.size() >= OUT_OF_CORE*(1048576L/40))
+        spill_matches(pair_ids.size());
+    return true;
+}
+
+template <class T>
+static void permute(vector<T> &v, const vector<int> &to)
+/* move v[i] to v[to[i]] */
+{
+    vector<T> w(v.size());
+    int i, n = v.size();
+    for (i=0; i<n; i++) w[to[i]] = v[i];
+    v.swap(w);
+}
+
+bool index_pairs()
+/* name the mol_pairs seen by add_match(), renumber them in name order and
+ * reorder match_list by pair (CSR), so that chaining a pair only walks its
+ * own matches; once matches were spilled, the rest follow them and
+ * the chunks on disk are ordered instead; false with load_error set if
+ * two pairs get the same name */
+{
+    bool spilled = spill_index.fd >= 0;
+    if (spilled) spill_matches(pair_ids.size());
+
+    // the names join with '&', which chromosome names may contain as well
+    map<pair<int, int>, int>::iterator iq;
+    string name;
+    for (iq=pair_ids.begin(); iq!=pair_ids.end(); iq++)
+    {
+        name = mol_list[iq->first.first]+"&"+mol_list[iq->first.second];
+        if (!mol_pairs.insert(make_pair(name, iq->second)).second)
+        {
+            pair_ids.clear();
+            return input_error("Chromosome pair %s can be read two ways, "
+                               "rename the chromosomes that contain '&'",
+                               name.c_str());
+        }
+    }
+
+    int npairs = pair_ids.size(), nmatch = match_list.size(), i, k;
+    pair_ids.clear();
+    vector<int> rank(npairs), fill;
+    long start = clock1000();
+
+    map<string, int>::iterator ip;
+    pair_list.clear();
+    for (k=0, ip=mol_pairs.begin(); ip!=mol_pairs.end(); ip++, k++)
+    {
+        rank[ip->second] = k;
+        ip->second = k;
+        pair_list.push_back(ip->first);
+    }
+
+    if (spilled)
+    {
+        Match_store().swap(match_list);
+        index_spill(rank);
+        progress("%d mol_pairs indexed [%.3f seconds], %d matches in %d "
+                 "chunks spilled (%.1f MB)", npairs,
+                 (clock1000() - start)/1000., pair_offsets.back(),
+                 (int) spill_index.chunks.size(), spill_index.size/1e6);
+        return true;
+    }
+
+    // counting sort keeps the match_list order within each pair, the
+    // mol_pair column turns into the new place of each match
+    vector<int> &to = match_list.mol_pair;
+    pair_offsets.assign(npairs+1, 0);
+    for (i=0; i<nmatch; i++)
+    {
+        to[i] = rank[to[i]];
+        pair_offsets[to[i]+1]++;
+    }
+    for (k=0; k<npairs; k++) pair_offsets[k+1] += pair_offsets[k];
+    fill.assign(pair_offsets.begin(), pair_offsets.end()-1);
+    for (i=0; i<nmatch; i++) to[i] = fill[to[i]]++;
+    permute(match_list.gene1, to);
+    permute(match_list.gene2, to);
+    permute(match_list.score, to);
+    vector<int>().swap(to);
+
+    double elapsed = (clock1000() - start)/1000.;
+    progress("%d mol_pairs indexed [%.3f seconds], "
+             "saves %d scans of %d matches while chaining",
+             npairs, elapsed, MAX(npairs-1, 0), nmatch);
+    return true;
+}
+
+// gene name lookup, see index_genes()
+static vector<int> gene_index;
+
+static unsigned int hash_name(const char *name, int len)
+/* FNV-1a hash of a gene name */
+{
+    unsigned int h = 2166136261u;
+    int i;
+    for (i=0; i<len; i++) h = (h ^ (unsigned char) name[i]) * 16777619u;
+    return h;
+}
+
+void index_genes()
+/* open addressing hash from gene name to gene id, a name occurring twice
+ * in the .bed file resolves to the last one in chromosome order */
+{
+    int n = gene_list.size(), i, id;
+    unsigned int size = 16, h;
+    while (size < 2*(unsigned int) n) size <<= 1;
+    gene_index.assign(size, -1);
+
+    for (i=0; i<n; i++)
+    {
+        const string &s = gene_list[i].name;
+        h = hash_name(s.data(), s.size()) & (size-1);
+        while ((id = gene_index[h]) >= 0 && gene_list[id].name != s)
+            h = (h+1) & (size-1);
+        gene_index[h] = i;
+    }
+}
+
+int find_gene(const char *name, int len)
+/* gene id of name, -1 if it is not in the .bed file */
+{
+    if (gene_index.empty()) return -1;
+    unsigned int mask = gene_index.size()-1;
+    unsigned int h = hash_name(name, len) & mask;
+    int id;
+    while ((id = gene_index[h]) >= 0)
+    {
+        const string &s = gene_list[id].name;
+        if ((int) s.size() == len && memcmp(s.data(), name, len) == 0)
+            return id;
+        h = (h+1) & mask;
+    }
+    return -1;
+}
+
+int name_cmp(const char *a, int alen, const char *b, int blen)
+/* strcmp for tokens that are not null terminated */
+{
+    int i = memcmp(a, b, MIN(alen, blen));
+    return i ? i : alen - blen;
+}
+
 // filter the blast -m8 output by the following threshold:
 // lexically sorted, gene #1 < gene #2
 // non-self blast match
 // both be present in the mcl output file and in the same group
-void read_blast(const char *prefix_fn, bool gff_flag=true)
+
+bool read_blast(const char *prefix_fn, bool gff_flag=true)
+/* false with load_error set if the file can't be read or is malformed */
 {
-    char fn[LABEL_LEN], g1[LABEL_LEN], g2[LABEL_LEN];
+    char fn[LABEL_LEN];
+    const char *line, *end, *g1, *g2, *ev;
+    int len1, len2, lenev;
     double score;
-    Blast_record br;
-    int i;
+    int i, id1, id2;
 
-    sprintf(fn, "%s.blast", prefix_fn);
-    FILE *fp = mustOpen(fn, "r");
+    input_name(fn, prefix_fn, "blast");
+    Line_reader fp;
+    if (!fp.open(fn)) return false;
+    long start = clock1000();
 
-    int pair_id = 0;
-    int total_num = 0;
-    map<string, Gene_feat>::iterator it1, it2;
-    Gene_feat *gf1, *gf2;
-    while ( fscanf(fp, "%s%s%lg",
-                   &g1[0], &g2[0], &score)==3 )
+    int total_num = 0, selected_num = 0;
+    bool ok = true;
+    while (fp.next(line, end))
     {
+        // three columns: gene1, gene2, e-value
+        if (!next_token(line, end, g1, len1)) continue;
+        if (!next_token(line, end, g2, len2) ||
+                !next_token(line, end, ev, lenev) ||
+                next_token(line, end, g1, i))
+            ok = input_error("%s:%d: expected three columns "
+                             "(gene1 gene2 e-value)", fn, fp.line_no);
+        else if (!parse_double(ev, lenev, &score))
+            ok = input_error("%s:%d: bad e-value '%.*s'",
+                             fn, fp.line_no, lenev, ev);
+        if (!ok) break;
+
         total_num++;
         // swap lexically and ignore self match
-        i = strcmp(g1, g2);
+        i = name_cmp(g1, len1, g2, len2);
         if (i < 0)
         {
-            br.gene1.assign(g1);
-            br.gene2.assign(g2);
+            id1 = find_gene(g1, len1);
+            id2 = find_gene(g2, len2);
         }
         else if (i > 0)
         {
             // interchange
-            br.gene1.assign(g2);
-            br.gene2.assign(g1);
+            id1 = find_gene(g2, len2);
+            id2 = find_gene(g1, len1);
         }
         else continue;  // bug fixed by bao, May 22nd 2009
-        it1 = gene_map.find(br.gene1);
-        it2 = gene_map.find(br.gene2);
-        if (it1==gene_map.end() || it2==gene_map.end()) continue;
-        gf1 = &(it1->second), gf2 = &(it2->second);
-
-        // assert both has the same MCL node id
-        br.node = gf1->node;
-        if (gff_flag && br.node != gf2->node) continue;
-
-        if (gf1->mol.empty() || gf2->mol.empty()) continue;
-        br.mol_pair = gf1->mol+"&"+gf2->mol;
-        mol_pairs[br.mol_pair]++;
-
-        br.pair_id = pair_id++;
-        br.score = score;
-        match_list.push_back(br);
+        if (id1 < 0 || id2 < 0) continue;
+
+        if (add_match(id1, id2, score, gff_flag)) selected_num++;
+    }
+    if (!ok || fp.bad)
+    {
+        fp.close();
+        pair_ids.clear();
+        return false;
     }
 
-    int selected_num = match_list.size();
     progress("%d matches imported (%d discarded)",
              selected_num, total_num - selected_num);
 
-    fclose(fp);
+    double elapsed = MAX(clock1000() - start, 1)/1000.;
+    progress("%s: %.1f MB parsed [%.1f MB/s]", fn,
+             fp.size/1e6, fp.size/1e6/elapsed);
+    fp.close();
+
+    return index_pairs();
 }
 
-void read_mcl(const char *prefix_fn)
+bool read_mcl(const char *prefix_fn)
+/* false with load_error set if the file can't be read */
 {
-    char delims[] = " \t\r\n";
-    char *atom = NULL;
     char fn[LABEL_LEN];
+    const char *line, *end, *atom;
+    int len;
 
-    sprintf(fn, "%s.mcl", prefix_fn);
-    FILE *fp = mustOpen(fn, "r");
+    input_name(fn, prefix_fn, "mcl");
+    Line_reader fp;
+    if (!fp.open(fn)) return false;
 
-    int node_num = 0;
-    size_t n = 0;
-    char *line;
-    map<string, Gene_feat>::iterator it;
+    // one gene family per line
+    int node_num = 0, id;
     Gene_feat *gf;
-    while (getline(&line, &n, fp)>=0)
+    while (fp.next(line, end))
     {
-        atom = strtok(line, delims);
-        while (atom != NULL)
+        while (next_token(line, end, atom, len))
         {
-            if ((it=gene_map.find(string(atom))) != gene_map.end())
+            if ((id=find_gene(atom, len)) >= 0)
             {
-                gf = &(it->second);
+                gf = &gene_list[id];
                 gf->node = node_num;
-                if (!gf->mol.empty()) chr_map[gf->mol].insert(gf);
+                chr_map[gf->mol].insert(gf);
             }
-            atom = strtok(NULL, delims);
         }
         node_num++;
     }
 
-    fclose(fp);
+    fp.close();
+    return !fp.bad;
 }
 
-void read_bed(const char *prefix_fn)
+bool read_bed(const char *prefix_fn)
+/* false with load_error set if the file can't be read or is malformed */
 {
-    char fn[LABEL_LEN], gn[LABEL_LEN], mol[LABEL_LEN];
-    int end5, end3;
+    char fn[LABEL_LEN];
+    const char *line, *end, *mol, *gn, *tok;
+    int len_mol, len_gn, len, end5, end3;
     Gene_feat gf;
-    // default position for genes are based on gene ranks
-    vector<Gene_feat> bed;
+    // chromosome name to id in the order first seen
+    map<string, int> mols;
+    map<string, int>::iterator im;
 
-    sprintf(fn, "%s.bed", prefix_fn);
-    FILE *fp = mustOpen(fn, "r");
+    input_name(fn, prefix_fn, "bed");
+    Line_reader fp;
+    if (!fp.open(fn)) return false;
 
-    while (fscanf(fp, "%s%d%d%s",
-                  &mol[0], &end5, &end3, &gn[0]) == 4)
+    gf.node = -1;
+    bool ok = true;
+    while (fp.next(line, end))
     {
-        gf.mol = string(mol);
-        gf.name = string(gn);
+        // chromosome, start, stop, gene name (further columns ignored)
+        if (!next_token(line, end, mol, len_mol)) continue;
+        if (!next_token(line, end, tok, len) || !parse_int(tok, len, &end5))
+            ok = input_error("%s:%d: bad start position", fn, fp.line_no);
+        else if (!next_token(line, end, tok, len) ||
+                 !parse_int(tok, len, &end3))
+            ok = input_error("%s:%d: bad stop position", fn, fp.line_no);
+        else if (!next_token(line, end, gn, len_gn))
+            ok = input_error("%s:%d: missing gene name", fn, fp.line_no);
+        if (!ok) break;
+
+        im = mols.insert(make_pair(string(mol, len_mol),
+                                   (int) mols.size())).first;
+        gf.mol = im->second;
+        gf.name.assign(gn, len_gn);
         gf.mid = end5;
-        bed.push_back(gf);
+        gene_list.push_back(gf);
     }
 
-    fclose(fp);
-    
-    // sort bed with respect to chromosome and position
-    sort(all(bed));
+    fp.close();
+    if (!ok || fp.bad) return false;
+
+    // renumber chromosomes in name order, so that comparing ids
+    // is the same as comparing names
+    vector<int> rank(mols.size());
+    mol_list.clear();
+    for (im=mols.begin(); im!=mols.end(); im++)
+    {
+        rank[im->second] = mol_list.size();
+        mol_list.push_back(im->first);
+    }
+    chr_map.resize(mol_list.size());
 
     vector<Gene_feat>::iterator bi;
+    tr(gene_list, bi) bi->mol = rank[bi->mol];
+
+    // sort bed with respect to chromosome and position
+    sort(all(gene_list));
+
+    // default position for genes are based on gene ranks
     unsigned int i = 0;
-    tr(bed, bi) 
-    { 
-        if (! USE_BP) bi->mid = i++; 
-        gene_map[bi->name] = *bi;
-        //printf("%s\n", bi->name.c_str());
-    }
+    if (! USE_BP) tr(gene_list, bi) bi->mid = i++;
+
+    index_genes();    return true;
 }
 
-static void filter_matches_x ()
+static void filter_repeats(vector<Score_t> &score, bool by_y)
+/* sort score by x (by y with by_y) and keep one match, the least e-value,
+ * out of every run of matches on the same gene that lie within
+ * OVERLAP_WINDOW of each other on the other axis; the winners are
+ * compacted in place */
 {
-    // match_bin is a list of records that are potentially repetitive
-    vector<Score_t> match_bin, score_cpy;
-    vector<Score_t>::const_iterator it, prev_rec;
-
-    sort(score.begin(), score.end());
-    prev_rec = it = score.begin();
-    it++;
-    match_bin.push_back(*(prev_rec));
-    for (; it != score.end(); it++)
-    {
-        // scan whether it has a linking window with previous one
-        if ((prev_rec->x != it->x) ||
-                (it->y - prev_rec->y) > OVERLAP_WINDOW)
-        {
-            // record last match_bin, take only least e-value
-            score_cpy.push_back(*min_element(match_bin.begin(),
-                                             match_bin.end(), cmp_ev));
-            // start a new match_bin
-            match_bin.clear();
-        }
-        match_bin.push_back(*it);
-        prev_rec = it;
-    }
-    // don't forget the last match_bin
-    score_cpy.push_back(*min_element(match_bin.begin(),
-                                     match_bin.end(), cmp_ev));
-    match_bin.clear();
+    int i, w, best, n = score.size();
+    bool same;
 
-    // copy into score
-    score.clear();
-    score = score_cpy;
-    score_cpy.clear();
-}
+    if (n == 0) return;
+    radix_sort(score, by_y);
 
-static void filter_matches_y ()
-{
-    // match_bin is a list of records that are potentially repetitive
-    vector<Score_t> match_bin, score_cpy;
-    vector<Score_t>::const_iterator it, prev_rec;
-
-    sort(score.begin(), score.end(), cmp_y);
-    prev_rec = it = score.begin();
-    it++;
-    match_bin.push_back(*(prev_rec));
-    for (; it != score.end(); it++)
+    // a run ends before i, all writes land before it
+    for (i=1, w=best=0; i<n; i++)
     {
-        // scan whether it has a linking window with previous one
-        if ((prev_rec->y != it->y) ||
-                (it->x - prev_rec->x) > OVERLAP_WINDOW)
+        const Score_t &prev_rec = score[i-1], &it = score[i];
+        if (by_y) same = prev_rec.y == it.y &&
+                             it.x - prev_rec.x <= OVERLAP_WINDOW;
+        else same = prev_rec.x == it.x &&
+                        it.y - prev_rec.y <= OVERLAP_WINDOW;
+
+        if (!same)
         {
-            // record last match_bin, take only least e-value
-            score_cpy.push_back(*min_element(match_bin.begin(),
-                                             match_bin.end(), cmp_ev));
-            // start a new match_bin
-            match_bin.clear();
+            score[w++] = score[best];
+            best = i;
         }
-        match_bin.push_back(*it);
-        prev_rec = it;
+        else if (cmp_ev(it, score[best])) best = i;
     }
-    // don't forget the last match_bin
-    score_cpy.push_back(*min_element(match_bin.begin(),
-                                     match_bin.end(), cmp_ev));
-    match_bin.clear();
-
-    // copy into score
-    score.clear();
-    score = score_cpy;
-    score_cpy.clear();
+    score[w++] = score[best];
+    score.resize(w);
 }
 
-// feed into dagchainer
-void feed_dag(const string &mol_pair)
+// anchors of a mol_pair for dagchainer, only reads the global data, so
+// different mol_pairs can run in parallel
+void pair_anchors(const Match_store &ms, int first, int last,
+                  vector<Score_t> &score)
+/* the matches first..last-1 of ms, which hold one mol_pair, as anchors
+ * filtered within OVERLAP_WINDOW, pairID is the index in ms */
 {
     // two additional filters will be applied here
     // best hsp (least e-value)
     // non-repetitive in a window of 50kb region
-    vector<Blast_record>::const_iterator it;
     Score_t cur_score;
+    int k;
 
-    for (it = match_list.begin(); it < match_list.end(); it++)
-    {
-        if (it->mol_pair != mol_pair) continue;
+    score.clear();
 
-        cur_score.pairID = it->pair_id;
-        cur_score.x = gene_map[it->gene1].mid;
-        cur_score.y = gene_map[it->gene2].mid;
+    for (k=first; k<last; k++)
+    {
+        cur_score.pairID = k;
+        cur_score.x = gene_list[ms.gene1[k]].mid;
+        cur_score.y = gene_list[ms.gene2[k]].mid;
         cur_score.score = MATCH_SCORE;
 
         score.push_back(cur_score);
@@ -247,9 +411,7 @@ void feed_dag(const string &mol_pair)
 
     // sort by both axis and remove redundant matches within
     // a given window length (default 50kb)
-    filter_matches_x();
-    filter_matches_y();
-
-    dag_main(score, mol_pair);
+    filter_repeats(score, false);
+    filter_repeats(score, true);
 }
 
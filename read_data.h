@@ -2,17 +2,20 @@
 #define __READ_DATA_H
 
 #include "basic.h"
+#include "line_reader.h"
+#include "spill.h"
 
 void read_blast(const string &prefix_fn);
 void read_mcl(const string &prefix_fn);
 void read_bed(const string &prefix_fn, int gff_flag=1);
 
-void feed_dag(const string &mol_pair);
+// gene id by name
+void index_genes();
+int find_gene(const char *name, int len);
+int name_cmp(const char *a, int alen, const char *b, int blen);
 
-// dagchainer
-extern void dag_main(vector<Score_t>& score, const string &mol_pair);
-
-// use gene name to search its node, mol, mid
-vector<Score_t> score;
+// building match_list, shared with ingest_m8
+bool add_match(int id1, int id2, double score, bool gff_flag);
+bool index_pairs();
 
 #endif
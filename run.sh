@@ -17,3 +17,18 @@ more ${PREFIX}.blast | ${EXE_FOLDER}/mcl - --abc --abc-neg-log -abc-tf 'mul(0.43
 # Run mcscan program
 ${EXE_FOLDER}/mcscan ${MCSCAN_PARAMS} ${PREFIX}
 
+# The default .aligns is pinned, block scores and e-values included, it
+# last changed when the anchor sort became stable (first hit of a
+# duplicated gene pair wins); the default .blocks last changed when the
+# partial order graph distances became one topological pass (spread_POG)
+if [ -z "${MCSCAN_PARAMS}" ]; then
+    echo "749a4018aff75186466f547c11fa132e  ${PREFIX}.aligns" | md5sum -c - || exit 1
+    echo "b69f662cae34588eadb7fd679bc4bb6e  ${PREFIX}.blocks" | md5sum -c - || exit 1
+fi
+
+
+# Both chaining engines must agree on the pairwise anchors
+${EXE_FOLDER}/mcscan -a ${MCSCAN_PARAMS} ${PREFIX}
+cp ${PREFIX}.aligns ${PREFIX}.aligns.classic
+${EXE_FOLDER}/mcscan -a --chain=sparse ${MCSCAN_PARAMS} ${PREFIX}
+cmp ${PREFIX}.aligns ${PREFIX}.aligns.classic && rm ${PREFIX}.aligns.classic
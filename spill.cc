@@ -0,0 +1,166 @@
+/*
+ * Matches on disk, for BLAST tables larger than memory (--out-of-core)
+ *
+ * add_match() appends to match_list as usual. Every OUT_OF_CORE MB,
+ * spill_matches() sorts the buffered matches by mol_pair and appends them
+ * to a temporary file as one chunk per pair. index_pairs() spills the
+ * rest and orders the chunks by pair, so that chaining reads back one pair
+ * at a time, with its matches in the order they were read, and frees it.
+ */
+
+#include "spill.h"
+
+Spill_index::~Spill_index()
+{
+    clear();
+}
+
+void Spill_index::clear()
+{
+    if (fd >= 0) close(fd);
+    fd = -1, size = 0;
+    chunks.clear(), pair_chunks.clear();
+}
+
+static void open_spill()
+/* an unlinked file in TMPDIR (/tmp by default), gone with the process */
+{
+    const char *dir = getenv("TMPDIR");
+    string fn = string(dir && *dir ? dir : "/tmp") + "/mcscan.XXXXXX";
+    vector<char> name(fn.begin(), fn.end());
+    name.push_back('\0');
+
+    spill_index.fd = mkstemp(&name[0]);
+    if (spill_index.fd < 0)
+        errAbort("Can't create %s: %s", &name[0], strerror(errno));
+    unlink(&name[0]);
+}
+
+static void write_spill(const char *p, size_t len)
+/* append p to the spill file */
+{
+    ssize_t n;
+    spill_index.size += len;
+    while (len > 0)
+    {
+        n = write(spill_index.fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) errAbort("Can't spill the matches: %s", strerror(errno));
+        p += n, len -= n;
+    }
+}
+
+static void read_spill(void *buf, size_t len, long offset)
+{
+    char *p = (char *) buf;
+    ssize_t n;
+    while (len > 0)
+    {
+        n = pread(spill_index.fd, p, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) errAbort("Can't read the spilled matches: %s",
+                                 n < 0 ? strerror(errno) : "end of file");
+        p += n, len -= n, offset += n;
+    }
+}
+
+template <class T>
+static char *put_column(char *p, const vector<T> &v, const vector<int> &order,
+                        int first, int last)
+/* v[order[first..last-1]] at p, returns the end */
+{
+    T *q = (T *) p;
+    int k;
+    for (k=first; k<last; k++) *q++ = v[order[k]];
+    return (char *) q;
+}
+
+void spill_matches(int npairs)
+/* move match_list to the spill file, one chunk for each of the npairs
+ * mol_pairs numbered by add_match() */
+{
+    Match_store &ms = match_list;
+    int n = ms.size(), i, p;
+    if (n == 0) return;
+    if (spill_index.fd < 0) open_spill();
+
+    // counting sort keeps the order of the matches within a pair
+    vector<int> start(npairs+1, 0), order(n), fill;
+    for (i=0; i<n; i++) start[ms.mol_pair[i]+1]++;
+    for (p=0; p<npairs; p++) start[p+1] += start[p];
+    fill.assign(start.begin(), start.end()-1);
+    for (i=0; i<n; i++) order[fill[ms.mol_pair[i]]++] = i;
+
+    // the columns of every chunk in a row, written at once
+    vector<char> buf((size_t) n * (2*sizeof(int) + sizeof(double)));
+    char *q = &buf[0];
+    Spill_chunk c;
+    for (p=0; p<npairs; p++)
+    {
+        if (start[p] == start[p+1]) continue;
+        c.offset = spill_index.size + (q - &buf[0]);
+        c.pair = p;
+        c.count = start[p+1] - start[p];
+        q = put_column(q, ms.gene1, order, start[p], start[p+1]);
+        q = put_column(q, ms.gene2, order, start[p], start[p+1]);
+        q = put_column(q, ms.score, order, start[p], start[p+1]);
+        spill_index.chunks.push_back(c);
+    }
+    write_spill(&buf[0], buf.size());
+    ms.clear();
+}
+
+static bool chunkCmp(const Spill_chunk &a, const Spill_chunk &b)
+{
+    return a.pair < b.pair;
+}
+
+void index_spill(const vector<int> &rank)
+/* once index_pairs() has put the pairs in name order (rank of each
+ * add_match() number): order the chunks by pair and count the matches of
+ * every pair into pair_offsets */
+{
+    Spill_index &s = spill_index;
+    int npairs = rank.size(), p;
+    vector<Spill_chunk>::iterator it;
+
+    tr(s.chunks, it) it->pair = rank[it->pair];
+    stable_sort(all(s.chunks), chunkCmp);
+
+    s.pair_chunks.assign(npairs+1, 0);
+    pair_offsets.assign(npairs+1, 0);
+    tr(s.chunks, it)
+    {
+        s.pair_chunks[it->pair+1]++;
+        pair_offsets[it->pair+1] += it->count;
+    }
+    for (p=0; p<npairs; p++)
+    {
+        s.pair_chunks[p+1] += s.pair_chunks[p];
+        pair_offsets[p+1] += pair_offsets[p];
+    }
+}
+
+void load_spilled(int mol_pair, Match_store &ms)
+/* the matches of mol_pair read back into ms, safe to call from several
+ * threads at once */
+{
+    const Spill_index &s = spill_index;
+    int k, n = 0;
+
+    ms.clear();
+    ms.gene1.resize(pair_offsets[mol_pair+1] - pair_offsets[mol_pair]);
+    ms.gene2.resize(ms.gene1.size());
+    ms.score.resize(ms.gene1.size());
+    for (k=s.pair_chunks[mol_pair]; k<s.pair_chunks[mol_pair+1]; k++)
+    {
+        const Spill_chunk &c = s.chunks[k];
+        long at = c.offset;
+        read_spill(&ms.gene1[n], c.count * sizeof(int), at);
+        at += c.count * sizeof(int);
+        read_spill(&ms.gene2[n], c.count * sizeof(int), at);
+        at += c.count * sizeof(int);
+        read_spill(&ms.score[n], c.count * sizeof(double), at);
+        n += c.count;
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef __SPILL_H
+#define __SPILL_H
+
+#include "basic.h"
+#include <unistd.h>
+
+void spill_matches(int npairs);
+void index_spill(const vector<int> &rank);
+void load_spilled(int mol_pair, Match_store &ms);
+
+#endif